@@ -0,0 +1,420 @@
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alerts.h"
+
+#define DEQUE_INITIAL_CAPACITY 16
+#define CHILDREN_INITIAL_CAPACITY 8
+
+extern char ** environ;
+
+//-------------------------DEQUE---------------------------
+static int deque_push(Alert_Deque * d, double time, double price) {
+	if (d->length == d->capacity) {
+		int capacity = d->capacity ? d->capacity * 2 : DEQUE_INITIAL_CAPACITY;
+		double * times = (double *)malloc(capacity * sizeof(double));
+		double * prices = (double *)malloc(capacity * sizeof(double));
+		if (!times || !prices) {
+			free(times);
+			free(prices);
+			return 0;
+		}
+		int i;
+		for (i = 0; i < d->length; ++i) {
+			times[i] = d->times[(d->head + i) % d->capacity];
+			prices[i] = d->prices[(d->head + i) % d->capacity];
+		}
+		free(d->times);
+		free(d->prices);
+		d->times = times;
+		d->prices = prices;
+		d->head = 0;
+		d->capacity = capacity;
+	}
+	int tail = (d->head + d->length++) % d->capacity;
+	d->times[tail] = time;
+	d->prices[tail] = price;
+	return 1;
+}
+
+static double deque_back(Alert_Deque * d) {
+	return d->prices[(d->head + d->length - 1) % d->capacity];
+}
+
+static void deque_expire(Alert_Deque * d, double oldest) {
+	while (d->length > 1 && d->times[d->head] < oldest) {
+		d->head = (d->head + 1) % d->capacity;
+		--d->length;
+	}
+}
+
+//-------------------------INDEX---------------------------
+static int compare_keys(const void * a, const void * b) {
+	double x = ((const Alert_Key *)a)->value;
+	double y = ((const Alert_Key *)b)->value;
+	return x < y ? -1 : x > y;
+}
+
+static int compare_indices(const void * a, const void * b) {
+	return strcmp(((const Alert_Index *)a)->instrument, ((const Alert_Index *)b)->instrument);
+}
+
+// First key whose value is > value (strict) or >= value
+static int bound(Alert_Key * keys, int n, double value, int strict) {
+	int lo = 0, hi = n;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (keys[mid].value < value || (strict && keys[mid].value == value)) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return lo;
+}
+
+static void free_index(Alert_Index * index) {
+	free(index->above);
+	free(index->below);
+	int i;
+	for (i = 0; i < index->num_windows; ++i) {
+		Alert_Window * w = &index->windows[i];
+		free(w->keys);
+		free(w->min.times);
+		free(w->min.prices);
+		free(w->max.times);
+		free(w->max.prices);
+	}
+	free(index->windows);
+}
+
+static int build_index(Alert_Rules * rules, Alert_Index * index, const char * name) {
+	memset(index, 0, sizeof(Alert_Index));
+	snprintf(index->instrument, sizeof(index->instrument), "%s", name);
+
+	int i, j;
+	int num_above = 0, num_below = 0, num_move = 0;
+	for (i = 0; i < rules->num_rules; ++i) {
+		Alert_Rule * rule = &rules->rules[i];
+		if (strcmp(rule->instrument, name) && strcmp(rule->instrument, "*")) continue;
+		if (rule->type == ALERT_ABOVE || rule->type == ALERT_CROSS) ++num_above;
+		if (rule->type == ALERT_BELOW || rule->type == ALERT_CROSS) ++num_below;
+		if (rule->type == ALERT_MOVE) ++num_move;
+	}
+
+	index->above = calloc(num_above + 1, sizeof(Alert_Key));
+	index->below = calloc(num_below + 1, sizeof(Alert_Key));
+	index->windows = calloc(num_move + 1, sizeof(Alert_Window));
+	if (!index->above || !index->below || !index->windows) {
+		free_index(index);
+		return 0;
+	}
+
+	for (i = 0; i < rules->num_rules; ++i) {
+		Alert_Rule * rule = &rules->rules[i];
+		if (strcmp(rule->instrument, name) && strcmp(rule->instrument, "*")) continue;
+		Alert_Key key = {rule->value, i};
+		if (rule->type == ALERT_ABOVE || rule->type == ALERT_CROSS) index->above[index->num_above++] = key;
+		if (rule->type == ALERT_BELOW || rule->type == ALERT_CROSS) index->below[index->num_below++] = key;
+		if (rule->type == ALERT_MOVE) {
+			for (j = 0; j < index->num_windows && index->windows[j].seconds != rule->seconds; ++j);
+			Alert_Window * w = &index->windows[j];
+			if (j == index->num_windows) {
+				++index->num_windows;
+				w->seconds = rule->seconds;
+				if (!(w->keys = calloc(num_move, sizeof(Alert_Key)))) {
+					free_index(index);
+					return 0;
+				}
+			}
+			w->keys[w->num_keys++] = key;
+		}
+	}
+
+	qsort(index->above, index->num_above, sizeof(Alert_Key), compare_keys);
+	qsort(index->below, index->num_below, sizeof(Alert_Key), compare_keys);
+	for (j = 0; j < index->num_windows; ++j) {
+		qsort(index->windows[j].keys, index->windows[j].num_keys, sizeof(Alert_Key), compare_keys);
+	}
+	return 1;
+}
+
+static Alert_Index * find_index(Alert_Rules * rules, const char * name) {
+	int lo = 0, hi = rules->num_indices;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int c = strcmp(rules->indices[mid].instrument, name);
+		if (!c) return &rules->indices[mid];
+		if (c < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	if (!rules->has_wildcards) return NULL;
+
+	// Instruments only covered by wildcard rules get their index on first sight
+	Alert_Index * indices = realloc(rules->indices, (rules->num_indices + 1) * sizeof(Alert_Index));
+	if (!indices) return NULL;
+	rules->indices = indices;
+	memmove(&indices[lo + 1], &indices[lo], (rules->num_indices - lo) * sizeof(Alert_Index));
+	if (!build_index(rules, &indices[lo], name)) {
+		memmove(&indices[lo], &indices[lo + 1], (rules->num_indices - lo) * sizeof(Alert_Index));
+		return NULL;
+	}
+	++rules->num_indices;
+	return &indices[lo];
+}
+
+//-------------------------LOADING-------------------------
+static int parse_rule(Alert_Rules * rules, char * line) {
+	char name[16], type[16];
+	char * comment = strchr(line, '#');
+	if (comment) *comment = 0;
+	int fields = sscanf(line, "%15s %15s", name, type);
+	if (fields < 1) return 1;
+
+	if (!strcmp(name, "hook")) {
+		char * command = strstr(line, "hook") + 4;
+		command += strspn(command, " \t");
+		command[strcspn(command, "\r\n")] = 0;
+		if (rules->hook) free(rules->hook);
+		rules->hook = *command ? strdup(command) : NULL;
+		return 1;
+	}
+	if (fields < 2) return 0;
+
+	Alert_Rule rule;
+	memset(&rule, 0, sizeof(rule));
+	strcpy(rule.instrument, name);
+	if (!strcmp(type, "above")) {
+		rule.type = ALERT_ABOVE;
+	} else if (!strcmp(type, "below")) {
+		rule.type = ALERT_BELOW;
+	} else if (!strcmp(type, "cross")) {
+		rule.type = ALERT_CROSS;
+	} else if (!strcmp(type, "move")) {
+		rule.type = ALERT_MOVE;
+	} else {
+		return 0;
+	}
+
+	if (rule.type == ALERT_MOVE) {
+		if (sscanf(line, "%*s %*s %lf %lf", &rule.value, &rule.seconds) != 2 || rule.seconds <= 0) return 0;
+		snprintf(rule.text, sizeof(rule.text), "%s move %g%% in %gs", name, rule.value, rule.seconds);
+	} else {
+		if (sscanf(line, "%*s %*s %lf", &rule.value) != 1) return 0;
+		snprintf(rule.text, sizeof(rule.text), "%s %s %g", name, type, rule.value);
+	}
+
+	Alert_Rule * new_rules = realloc(rules->rules, (rules->num_rules + 1) * sizeof(Alert_Rule));
+	if (!new_rules) return 0;
+	rules->rules = new_rules;
+	rules->rules[rules->num_rules++] = rule;
+	if (!strcmp(name, "*")) rules->has_wildcards = 1;
+	return 1;
+}
+
+Alert_Rules * load_alert_rules(const char * path) {
+	FILE * f = fopen(path, "r");
+	if (!f) {
+		fprintf(stderr, "Could not open alert rules %s\n", path);
+		return NULL;
+	}
+
+	Alert_Rules * rules = (Alert_Rules *)calloc(1, sizeof(Alert_Rules));
+	if (!rules) {
+		fclose(f);
+		return NULL;
+	}
+	pthread_mutex_init(&rules->mChildren, NULL);
+
+	char line[256];
+	int line_number = 0;
+	while (fgets(line, sizeof(line), f)) {
+		++line_number;
+		line[strcspn(line, "\r\n")] = 0;
+		if (!parse_rule(rules, line)) {
+			fprintf(stderr, "Could not parse alert rule on line %d: %s\n", line_number, line);
+		}
+	}
+	fclose(f);
+
+	// Explicitly named instruments are indexed up front, wildcard-only ones lazily
+	int i;
+	for (i = 0; i < rules->num_rules; ++i) {
+		Alert_Rule * rule = &rules->rules[i];
+		if (!strcmp(rule->instrument, "*")) continue;
+		int j;
+		for (j = 0; j < rules->num_indices && strcmp(rules->indices[j].instrument, rule->instrument); ++j);
+		if (j < rules->num_indices) continue;
+
+		Alert_Index * indices = realloc(rules->indices, (rules->num_indices + 1) * sizeof(Alert_Index));
+		if (!indices) break;
+		rules->indices = indices;
+		if (build_index(rules, &indices[rules->num_indices], rule->instrument)) ++rules->num_indices;
+	}
+	qsort(rules->indices, rules->num_indices, sizeof(Alert_Index), compare_indices);
+
+	return rules;
+}
+
+static void reap_children(Alert_Rules * rules) {
+	int i = 0;
+	while (i < rules->num_children) {
+		if (waitpid(rules->children[i], NULL, WNOHANG)) {
+			rules->children[i] = rules->children[--rules->num_children];
+		} else {
+			++i;
+		}
+	}
+}
+
+void delete_alert_rules(Alert_Rules * rules) {
+	if (rules) {
+		reap_children(rules);
+		free(rules->children);
+		pthread_mutex_destroy(&rules->mChildren);
+		int i;
+		for (i = 0; i < rules->num_indices; ++i) {
+			free_index(&rules->indices[i]);
+		}
+		free(rules->indices);
+		free(rules->rules);
+		if (rules->hook) free(rules->hook);
+		free(rules);
+	}
+}
+
+//-------------------------EVALUATION----------------------
+static void fire_alert(Alert_Batch * batch, int rule, double price) {
+	if (batch->num_fired == ALERT_BATCH) {
+		++batch->dropped;
+		return;
+	}
+	batch->fired[batch->num_fired].rule = rule;
+	batch->fired[batch->num_fired].price = price;
+	++batch->num_fired;
+}
+
+static int check_window(Alert_Batch * batch, Alert_Window * w, double price, double now) {
+	while (w->min.length && deque_back(&w->min) >= price) --w->min.length;
+	while (w->max.length && deque_back(&w->max) <= price) --w->max.length;
+	if (!deque_push(&w->min, now, price) || !deque_push(&w->max, now, price)) return 0;
+	deque_expire(&w->min, now - w->seconds);
+	deque_expire(&w->max, now - w->seconds);
+
+	double low = w->min.prices[w->min.head];
+	double high = w->max.prices[w->max.head];
+	double up = low > 0 ? (price - low) / low : 0;
+	double down = high > 0 ? (high - price) / high : 0;
+	double move = (up > down ? up : down) * 100;
+
+	// keys[0, fired) have already fired; they re-arm once the move falls back below them
+	int reached = bound(w->keys, w->num_keys, move, 1);
+	int i, count = 0;
+	for (i = w->fired; i < reached; ++i, ++count) {
+		fire_alert(batch, w->keys[i].rule, price);
+	}
+	w->fired = reached;
+	return count;
+}
+
+int check_alerts(Alert_Rules * rules, Alert_Batch * batch, const char * instrument, double old_price, double price, double now) {
+	snprintf(batch->instrument, sizeof(batch->instrument), "%s", instrument);
+	batch->num_fired = 0;
+	batch->dropped = 0;
+	if (!rules) return 0;
+
+	Alert_Index * index = find_index(rules, instrument);
+	if (!index) return 0;
+
+	int i, count = 0;
+	if (old_price > 0 && price > old_price) {
+		int last = bound(index->above, index->num_above, price, 1);
+		for (i = bound(index->above, index->num_above, old_price, 1); i < last; ++i, ++count) {
+			fire_alert(batch, index->above[i].rule, price);
+		}
+	} else if (old_price > 0 && price < old_price) {
+		int last = bound(index->below, index->num_below, old_price, 0);
+		for (i = bound(index->below, index->num_below, price, 0); i < last; ++i, ++count) {
+			fire_alert(batch, index->below[i].rule, price);
+		}
+	}
+
+	if (price > 0) {
+		for (i = 0; i < index->num_windows; ++i) {
+			count += check_window(batch, &index->windows[i], price, now);
+		}
+	}
+	return count;
+}
+
+//-------------------------HOOK----------------------------
+static pid_t spawn_hook(Alert_Rules * rules, Alert_Rule * rule, const char * instrument, double price) {
+	int num_env;
+	for (num_env = 0; environ[num_env]; ++num_env);
+	char ** env = (char **)malloc((num_env + 4) * sizeof(char *));
+	if (!env) return 0;
+
+	char env_instrument[32], env_price[48], env_rule[96];
+	snprintf(env_instrument, sizeof(env_instrument), "ALERT_INSTRUMENT=%s", instrument);
+	snprintf(env_price, sizeof(env_price), "ALERT_PRICE=%f", price);
+	snprintf(env_rule, sizeof(env_rule), "ALERT_RULE=%s", rule->text);
+	env[0] = env_instrument;
+	env[1] = env_price;
+	env[2] = env_rule;
+	memcpy(env + 3, environ, (num_env + 1) * sizeof(char *));
+
+	// The hook shares our terminal, so its output would land in the UI
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+
+	pid_t pid;
+	char * argv[] = {"sh", "-c", rules->hook, NULL};
+	if (posix_spawn(&pid, "/bin/sh", &actions, NULL, argv, env)) {
+		fprintf(stderr, "Could not run alert hook %s\n", rules->hook);
+		pid = 0;
+	}
+	posix_spawn_file_actions_destroy(&actions);
+	free(env);
+	return pid;
+}
+
+static void add_child(Alert_Rules * rules, pid_t pid) {
+	if (rules->num_children == rules->children_capacity) {
+		int capacity = rules->children_capacity ? rules->children_capacity * 2 : CHILDREN_INITIAL_CAPACITY;
+		pid_t * children = realloc(rules->children, capacity * sizeof(pid_t));
+		if (!children) return;
+		rules->children = children;
+		rules->children_capacity = capacity;
+	}
+	rules->children[rules->num_children++] = pid;
+}
+
+void run_alerts(Alert_Rules * rules, Alert_Batch * batch) {
+	if (!rules) return;
+	int i;
+	for (i = 0; i < batch->num_fired; ++i) {
+		fprintf(stderr, "Alert %s: %s at %f\n", batch->instrument, rules->rules[batch->fired[i].rule].text, batch->fired[i].price);
+	}
+	if (batch->dropped) fprintf(stderr, "Alert %s: %d more rules fired\n", batch->instrument, batch->dropped);
+	if (!rules->hook) return;
+
+	pid_t pids[ALERT_BATCH];
+	for (i = 0; i < batch->num_fired; ++i) {
+		pids[i] = spawn_hook(rules, &rules->rules[batch->fired[i].rule], batch->instrument, batch->fired[i].price);
+	}
+
+	// Only our own hooks are reaped; other children of the process are left alone
+	pthread_mutex_lock(&rules->mChildren);
+	reap_children(rules);
+	for (i = 0; i < batch->num_fired; ++i) {
+		if (pids[i]) add_child(rules, pids[i]);
+	}
+	pthread_mutex_unlock(&rules->mChildren);
+}
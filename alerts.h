@@ -0,0 +1,92 @@
+#ifndef ALERTS
+#define ALERTS
+
+#include <pthread.h>
+#include <sys/types.h>
+
+#define ALERT_DRAW_STATE 120
+#define ALERT_BATCH 16
+
+/*
+ * Rules file, one rule per line ('#' starts a comment):
+ *   EUR_USD above 1.10      price crosses 1.10 upwards
+ *   EUR_USD below 1.05      price crosses 1.05 downwards
+ *   EUR_USD cross 1.08      price crosses 1.08 either way
+ *   * move 0.5 300          any instrument moves 0.5% within 300 seconds
+ *   hook notify-send        command run for every alert
+ * The hook gets ALERT_INSTRUMENT, ALERT_PRICE and ALERT_RULE in its environment.
+ *
+ * check_alerts runs under the state lock, so it only collects the rules that
+ * fired into an Alert_Batch; run_alerts logs them to stderr and starts the
+ * hook once the lock has been released.
+ */
+typedef enum { ALERT_ABOVE, ALERT_BELOW, ALERT_CROSS, ALERT_MOVE } Alert_Type;
+
+typedef struct {
+	char instrument[16];
+	Alert_Type type;
+	double value;
+	double seconds;
+	char text[64];
+} Alert_Rule;
+
+typedef struct {
+	double value;
+	int rule;
+} Alert_Key;
+
+typedef struct {
+	double * times;
+	double * prices;
+	int head, length, capacity;
+} Alert_Deque;
+
+typedef struct {
+	double seconds;
+	Alert_Key * keys;
+	int num_keys;
+	int fired;
+	Alert_Deque min, max;
+} Alert_Window;
+
+typedef struct {
+	char instrument[16];
+	Alert_Key * above;
+	int num_above;
+	Alert_Key * below;
+	int num_below;
+	Alert_Window * windows;
+	int num_windows;
+} Alert_Index;
+
+typedef struct {
+	int rule;
+	double price;
+} Alert_Fired;
+
+typedef struct {
+	char instrument[16];
+	Alert_Fired fired[ALERT_BATCH];
+	int num_fired;
+	int dropped;
+} Alert_Batch;
+
+typedef struct Alert_Rules {
+	Alert_Rule * rules;
+	int num_rules;
+	Alert_Index * indices;
+	int num_indices;
+	int has_wildcards;
+	char * hook;
+	pid_t * children;
+	int num_children;
+	int children_capacity;
+	pthread_mutex_t mChildren;
+} Alert_Rules;
+
+Alert_Rules * load_alert_rules(const char * path);
+void delete_alert_rules(Alert_Rules * rules);
+int check_alerts(Alert_Rules * rules, Alert_Batch * batch, const char * instrument, double old_price, double price, double now);
+void run_alerts(Alert_Rules * rules, Alert_Batch * batch);
+
+#endif
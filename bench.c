@@ -0,0 +1,215 @@
+#include <json/json.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "s_string.h"
+#include "poll_t.h"
+#include "grid.h"
+#include "prices.h"
+
+#define FIXTURE "fixtures/poll.json"
+#define MIN_BENCH_TIME 200000000
+#define CHUNK_SIZE 1448
+#define SCREEN_WIDTH 1920
+#define SCREEN_HEIGHT 1080
+
+static int DEFAULT_COUNTS[] = {10, 40, 160, 640, 2560};
+
+typedef struct {
+	int num_instruments;
+	char * response;
+	size_t response_length;
+	struct String message;
+	int num_prices;
+	char (* names)[16];
+	double * bids;
+	double * asks;
+	State * state;
+	State * target;
+} Bench_Context;
+
+//-------------------------FIXTURES------------------------
+char * read_file(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char * data = (char *)malloc(length + 1);
+	if (data && fread(data, 1, length, f) != length) {
+		free(data);
+		data = NULL;
+	}
+	if (data) data[length] = 0;
+	fclose(f);
+	return data;
+}
+
+/*
+ * Builds a poll response with num_instruments entries by cycling through the
+ * captured fixture; repeated entries get a numeric suffix so names stay unique.
+ */
+char * build_response(struct json_object * fixture, int num_instruments) {
+	struct json_object * prices;
+	if (!json_object_object_get_ex(fixture, "prices", &prices)) return NULL;
+	int fixture_length = json_object_array_length(prices);
+	if (!fixture_length) return NULL;
+
+	size_t capacity = 64 + num_instruments * 128;
+	char * response = (char *)malloc(capacity);
+	if (!response) return NULL;
+	size_t length = sprintf(response, "{\"prices\":[");
+
+	int i;
+	for (i = 0; i < num_instruments; ++i) {
+		struct json_object * entry = json_object_array_get_idx(prices, i % fixture_length);
+		struct json_object * name, * time, * bid, * ask;
+		json_object_object_get_ex(entry, "instrument", &name);
+		json_object_object_get_ex(entry, "time", &time);
+		json_object_object_get_ex(entry, "bid", &bid);
+		json_object_object_get_ex(entry, "ask", &ask);
+
+		char instrument[16];
+		if (i < fixture_length) {
+			snprintf(instrument, sizeof(instrument), "%s", json_object_get_string(name));
+		} else {
+			snprintf(instrument, sizeof(instrument), "%s_%d", json_object_get_string(name), i / fixture_length);
+		}
+		length += sprintf(response + length, "%s{\"instrument\":\"%s\",\"time\":\"%s\",\"bid\":%s,\"ask\":%s}",
+				i ? "," : "", instrument, json_object_get_string(time),
+				json_object_get_string(bid), json_object_get_string(ask));
+	}
+	sprintf(response + length, "]}");
+	return response;
+}
+
+void collect_price(void * arg, const char * instrument, double time, double bid, double ask) {
+	Bench_Context * c = (Bench_Context *)arg;
+	strcpy(c->names[c->num_prices], instrument);
+	c->bids[c->num_prices] = bid;
+	c->asks[c->num_prices] = ask;
+	++c->num_prices;
+}
+
+void ignore_price(void * arg, const char * instrument, double time, double bid, double ask) {
+}
+
+State * build_state(Bench_Context * c) {
+	State * state = new_state();
+	if (!state) return NULL;
+
+	int i;
+	for (i = 0; i < c->num_prices; ++i) {
+		add_instrument(state, c->names[i]);
+	}
+	return state;
+}
+
+//-------------------------BENCHMARKS----------------------
+void bench_write_func(Bench_Context * c) {
+	reset_string(&c->message);
+	size_t offset;
+	for (offset = 0; offset < c->response_length; offset += CHUNK_SIZE) {
+		size_t chunk = c->response_length - offset < CHUNK_SIZE ? c->response_length - offset : CHUNK_SIZE;
+		write_func(c->response + offset, 1, chunk, &c->message);
+	}
+}
+
+void bench_parse(Bench_Context * c) {
+	parse_prices(c->response, ignore_price, NULL);
+}
+
+void bench_setup_instrument(Bench_Context * c) {
+	int i;
+	for (i = 0; i < c->num_prices; ++i) {
+		setup_instrument(c->state, c->names[i], c->bids[i], c->asks[i], 0, 0);
+	}
+}
+
+void bench_copy_state(Bench_Context * c) {
+	c->state->ready = 1;
+	copy_state(c->target, c->state, 1);
+}
+
+void bench_grid(Bench_Context * c) {
+	volatile Dimension d = get_grid_for_num_instruments(c->num_instruments, SCREEN_WIDTH, SCREEN_HEIGHT);
+	(void)d;
+}
+
+//-------------------------HARNESS-------------------------
+long elapsed_ns(struct timespec * start, struct timespec * end) {
+	return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Doubles the iteration count until one batch runs for at least
+ * MIN_BENCH_TIME, then reports the time per call of that batch.
+ */
+void run_bench(const char * name, void (*bench)(Bench_Context *), Bench_Context * c) {
+	long iterations = 1;
+	long elapsed;
+	for (;;) {
+		struct timespec start, end;
+		long i;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+		for (i = 0; i < iterations; ++i) {
+			bench(c);
+		}
+		clock_gettime(CLOCK_MONOTONIC, &end);
+		elapsed = elapsed_ns(&start, &end);
+		if (elapsed >= MIN_BENCH_TIME) break;
+		iterations *= 2;
+	}
+	printf("%s,%d,%ld,%.1f\n", name, c->num_instruments, iterations, (double)elapsed / iterations);
+	fflush(stdout);
+}
+
+int main(int argc, char ** argv) {
+	char * fixture_data = read_file(FIXTURE);
+	struct json_object * fixture = fixture_data ? json_tokener_parse(fixture_data) : NULL;
+	if (!fixture) {
+		printf("Could not load fixture %s\n", FIXTURE);
+		return 1;
+	}
+
+	int num_counts = argc > 1 ? argc - 1 : sizeof(DEFAULT_COUNTS) / sizeof(int);
+	printf("benchmark,instruments,iterations,ns_per_op\n");
+
+	int i;
+	for (i = 0; i < num_counts; ++i) {
+		Bench_Context c;
+		c.num_instruments = argc > 1 ? atoi(argv[i + 1]) : DEFAULT_COUNTS[i];
+		if (c.num_instruments <= 0) continue;
+		c.response = build_response(fixture, c.num_instruments);
+		if (!c.response) continue;
+		c.response_length = strlen(c.response);
+		memset(&c.message, 0, sizeof(c.message));
+		c.num_prices = 0;
+		c.names = calloc(c.num_instruments, sizeof(*c.names));
+		c.bids = calloc(c.num_instruments, sizeof(double));
+		c.asks = calloc(c.num_instruments, sizeof(double));
+		if (!c.names || !c.bids || !c.asks) return 1;
+		parse_prices(c.response, collect_price, &c);
+		c.state = build_state(&c);
+		c.target = new_state();
+
+		run_bench("write_func", bench_write_func, &c);
+		run_bench("parse", bench_parse, &c);
+		run_bench("setup_instrument", bench_setup_instrument, &c);
+		run_bench("copy_state", bench_copy_state, &c);
+		run_bench("grid", bench_grid, &c);
+
+		delete_state(c.target);
+		delete_state(c.state);
+		free(c.message.data);
+		free(c.names);
+		free(c.bids);
+		free(c.asks);
+		free(c.response);
+	}
+
+	json_object_put(fixture);
+	free(fixture_data);
+	return 0;
+}
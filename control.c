@@ -0,0 +1,143 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "control.h"
+
+#define CONTROL_LINE 128
+#define CONTROL_BACKLOG 4
+#define CONTROL_TIMEOUT 1000
+#define SHUTDOWN_CHECK 100
+
+// A client that hangs up before reading its reply must not raise SIGPIPE in the whole process
+static void reply(int client, const char * line) {
+	size_t length = strlen(line);
+	if (send(client, line, length, MSG_NOSIGNAL) != length) return;
+}
+
+// The names are copied out first, so a slow client never holds up the poll threads
+static int list_instruments(State * state, int client) {
+	lock_state(state);
+	int num_instruments = state->num_instruments;
+	char (* names)[16] = malloc((num_instruments ? num_instruments : 1) * sizeof(*names));
+	int i;
+	for (i = 0; names && i < num_instruments; ++i) {
+		strcpy(names[i], state->instruments[i].instrument);
+	}
+	unlock_state(state);
+	if (!names) return 1;
+
+	char line[32];
+	for (i = 0; i < num_instruments; ++i) {
+		snprintf(line, sizeof(line), "%s\n", names[i]);
+		reply(client, line);
+	}
+	free(names);
+	return 0;
+}
+
+static void run_command(State * state, int client, char * line) {
+	char command[16], argument[CONTROL_LINE];
+	int n = sscanf(line, "%15s %127s", command, argument);
+	int failed = 1;
+	if (n == 2 && !strcmp(command, "add")) {
+		failed = subscribe_instrument(state, argument);
+	} else if (n == 2 && !strcmp(command, "remove")) {
+		failed = unsubscribe_instrument(state, argument);
+	} else if (n == 1 && !strcmp(command, "list")) {
+		failed = list_instruments(state, client);
+	} else if (n > 0) {
+		fprintf(stderr, "Unknown control command: %s\n", line);
+	} else {
+		return;
+	}
+	reply(client, failed ? "error\n" : "ok\n");
+}
+
+// Reads newline-terminated commands until the client closes, goes quiet or shutdown starts
+static void handle_client(State * state, int client) {
+	char buffer[CONTROL_LINE];
+	size_t length = 0;
+	struct pollfd pfd;
+	pfd.fd = client;
+	pfd.events = POLLIN;
+	while (is_ready(state) >= 0 && poll(&pfd, 1, CONTROL_TIMEOUT) > 0) {
+		ssize_t count = read(client, buffer + length, sizeof(buffer) - 1 - length);
+		if (count <= 0) break;
+		length += count;
+		buffer[length] = 0;
+
+		char * start = buffer, * end;
+		while ((end = strchr(start, '\n'))) {
+			*end = 0;
+			run_command(state, client, start);
+			start = end + 1;
+		}
+		length -= start - buffer;
+		memmove(buffer, start, length);
+		if (length == sizeof(buffer) - 1) {
+			reply(client, "error\n");
+			break;
+		}
+	}
+	if (length) {
+		buffer[length] = 0;
+		run_command(state, client, buffer);
+	}
+}
+
+static void * control_t(void * arg) {
+	State * state = (State *)arg;
+	struct pollfd pfd;
+	pfd.fd = state->control_fd;
+	pfd.events = POLLIN;
+	while (is_ready(state) >= 0) {
+		if (poll(&pfd, 1, SHUTDOWN_CHECK) <= 0) continue;
+		int client = accept(state->control_fd, NULL, NULL);
+		if (client < 0) continue;
+		handle_client(state, client);
+		close(client);
+	}
+	close(state->control_fd);
+	state->control_fd = -1;
+	unlink(state->control_path);
+	return NULL;
+}
+
+pthread_t setup_control_thread(State * state) {
+	if (!state || !state->control_path) return 0;
+
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(state->control_path) >= sizeof(address.sun_path)) {
+		fprintf(stderr, "Control socket path is too long: %s\n", state->control_path);
+		return 0;
+	}
+	strcpy(address.sun_path, state->control_path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		fprintf(stderr, "Unable to create control socket %s\n", state->control_path);
+		return 0;
+	}
+	unlink(state->control_path);
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) || listen(fd, CONTROL_BACKLOG)) {
+		fprintf(stderr, "Unable to listen on control socket %s\n", state->control_path);
+		close(fd);
+		return 0;
+	}
+	state->control_fd = fd;
+
+	pthread_t thread = 0;
+	if (pthread_create(&thread, NULL, control_t, state)) {
+		close(fd);
+		state->control_fd = -1;
+		unlink(state->control_path);
+		thread = 0;
+	}
+	return thread;
+}
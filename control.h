@@ -0,0 +1,23 @@
+#ifndef CONTROL
+#define CONTROL
+
+#include <pthread.h>
+#include "poll_t.h"
+
+/*
+ * Runtime subscription changes over a Unix stream socket at
+ * state->control_path. Each line is one command and gets one reply line
+ * ("ok" or "error"):
+ *
+ *   add NAME[@group]
+ *   remove NAME
+ *   list              (replies with one NAME per line, then "ok")
+ *
+ * When the state is published to shared memory, add fails once the segment
+ * is full.
+ *
+ * For example: echo "add EUR_GBP" | nc -U /tmp/oanda.sock
+ */
+pthread_t setup_control_thread(State * state);
+
+#endif
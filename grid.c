@@ -0,0 +1,25 @@
+#include <math.h>
+#include "grid.h"
+
+Dimension get_grid_for_num_instruments(int num_instruments, int width, int height) {
+	Dimension d = {0};
+	if (!num_instruments) return d;
+
+	float ratio = (float)width / height;
+	d.x = round(sqrt(num_instruments * ratio));
+	d.y = (num_instruments - 1) / d.x + 1;
+	int i;
+	for (i = (d.x > d.y ? d.y : d.x); i > sqrt(num_instruments * ratio / 2); --i) {
+		if (num_instruments % i == 0) {
+			if (width > height) {
+				d.x = num_instruments / i;
+				d.y = i;
+			} else {
+				d.x = i;
+				d.y = num_instruments / i;
+			}
+			return d;
+		}
+	}
+	return d;
+}
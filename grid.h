@@ -0,0 +1,10 @@
+#ifndef GRID
+#define GRID
+
+typedef struct {
+	int x, y;
+} Dimension;
+
+Dimension get_grid_for_num_instruments(int num_instruments, int width, int height);
+
+#endif
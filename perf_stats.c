@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "perf_stats.h"
+
+void init_perf_stats(Perf_Stats * stats, const char * label, double log_interval) {
+	memset(stats, 0, sizeof(Perf_Stats));
+	snprintf(stats->label, sizeof(stats->label), "%s", label);
+	stats->log_interval = log_interval;
+	stats->last_log = get_monotonic_time();
+}
+
+void perf_record(Perf_Window * window, double value) {
+	window->samples[window->next] = value;
+	window->next = (window->next + 1) % PERF_SAMPLES;
+	if (window->count < PERF_SAMPLES) ++window->count;
+}
+
+static int compare_samples(const void * a, const void * b) {
+	double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+Perf_Summary perf_summarize(Perf_Window * window) {
+	Perf_Summary summary = {0};
+	if (!window->count) return summary;
+
+	double sorted[PERF_SAMPLES];
+	memcpy(sorted, window->samples, window->count * sizeof(double));
+	qsort(sorted, window->count, sizeof(double), compare_samples);
+	summary.count = window->count;
+	summary.min = sorted[0];
+	summary.median = sorted[window->count / 2];
+	summary.p99 = sorted[(window->count - 1) * 99 / 100];
+	summary.max = sorted[window->count - 1];
+	return summary;
+}
+
+static int format_window(char * out, size_t size, const char * name, Perf_Window * window) {
+	Perf_Summary s = perf_summarize(window);
+	return snprintf(out, size, "%-12s p50 %7.1f  p99 %7.1f  max %7.1f ms (%d)\n",
+			name, s.median * 1000, s.p99 * 1000, s.max * 1000, s.count);
+}
+
+// Writes one line per statistic into out
+void format_perf_stats(Perf_Stats * stats, char * out, size_t size) {
+	size_t length = 0;
+	Perf_Window * windows[] = {&stats->tick_age, &stats->receive_age, &stats->frame_time};
+	const char * names[] = {"tick age", "receive age", "frame time"};
+	int i;
+	for (i = 0; i < 3 && length < size; ++i) {
+		int n = format_window(out + length, size - length, names[i], windows[i]);
+		if (n < 0) break;
+		length += n;
+	}
+	if (!size) return;
+	if (length >= size) length = size - 1;
+	out[length] = 0;
+}
+
+static void log_perf_stats(Perf_Stats * stats) {
+	char text[256];
+	format_perf_stats(stats, text, sizeof(text));
+	char * line = text, * end;
+	while ((end = strchr(line, '\n'))) {
+		*end = 0;
+		fprintf(stderr, "[%s] %s\n", stats->label, line);
+		line = end + 1;
+	}
+	fflush(stderr);
+}
+
+/*
+ * Called right after a frame is presented. Every instrument in the slice
+ * that changed in this frame's copy contributes one tick and receive age.
+ */
+void perf_record_present(Perf_Stats * stats, State * state, int first, int count) {
+	double now = get_monotonic_time();
+	if (stats->last_present) perf_record(&stats->frame_time, now - stats->last_present);
+	stats->last_present = now;
+
+	lock_state(state);
+	if (state->ready > 0) {
+		double wall = get_wall_time();
+		int i;
+		for (i = first; i < first + count && i < state->num_instruments; ++i) {
+			Instrument_State * is = &state->instruments[i];
+			if (!is->changed) continue;
+			if (is->server_time) perf_record(&stats->tick_age, wall - is->server_time);
+			if (is->receive_time) perf_record(&stats->receive_age, wall - is->receive_time);
+		}
+	}
+	unlock_state(state);
+
+	if (stats->log_interval > 0 && now - stats->last_log >= stats->log_interval) {
+		stats->last_log = now;
+		log_perf_stats(stats);
+	}
+}
@@ -0,0 +1,44 @@
+#ifndef PERF_STATS
+#define PERF_STATS
+
+#include <stddef.h>
+#include "poll_t.h"
+
+#define PERF_SAMPLES 512
+
+/*
+ * Rolling latency statistics for one render loop, sampled when a frame is
+ * presented. tick_age runs from the server timestamp of a price to the
+ * present that first shows it, so it includes any clock skew between the
+ * server and this host; receive_age covers only the local part, from the
+ * poll response arriving to the present. frame_time is the interval between
+ * presents.
+ */
+typedef struct {
+	double samples[PERF_SAMPLES];
+	int count;
+	int next;
+} Perf_Window;
+
+typedef struct {
+	int count;
+	double min, median, p99, max;
+} Perf_Summary;
+
+typedef struct {
+	char label[32];
+	Perf_Window tick_age;
+	Perf_Window receive_age;
+	Perf_Window frame_time;
+	double last_present;
+	double last_log;
+	double log_interval;
+} Perf_Stats;
+
+void init_perf_stats(Perf_Stats * stats, const char * label, double log_interval);
+void perf_record(Perf_Window * window, double value);
+Perf_Summary perf_summarize(Perf_Window * window);
+void perf_record_present(Perf_Stats * stats, State * state, int first, int count);
+void format_perf_stats(Perf_Stats * stats, char * out, size_t size);
+
+#endif
@@ -5,15 +5,28 @@
 #include <stdlib.h>
 #include <poll.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <stdint.h>
 #include "poll_t.h"
+#include "alerts.h"
+#include "control.h"
+#include "prices.h"
+#include "shm_state.h"
+#include "spsc_queue.h"
 
 #define REFRESH_RATE 500000000
+#define MAX_REFRESH_RATE (REFRESH_RATE * 8L)
+#define MIN_CAPACITY 8
+#define POLL_BUFFERS 4
+#define SHUTDOWN_CHECK 100
+// Percent the scheduler's interval has to move before the timer is re-armed
+#define REARM_THRESHOLD 10
+// Diagnostics only quote the start of a bad response
+#define RESPONSE_EXCERPT 200
 #define PORT 80
 #define POLL_CALL "http://api-sandbox.oanda.com/v1/instruments/poll.json"
 
-unsigned long ID = 0;
-pthread_mutex_t mID;
-
 /*
 State * getState() {
 	if (!STATE) return NULL;
@@ -39,11 +52,22 @@ State * new_state() {
 	if (!state) return NULL;
 
 	state->num_instruments = 0;
+	state->capacity = 0;
 	state->instruments = NULL;
+	state->index = NULL;
+	state->index_capacity = 0;
 	pthread_mutex_init(&state->mState, NULL);
 	state->ready = 0;
-	state->message = NULL;
-	state->clockid = -1;
+	state->version = 0;
+	state->num_shards = 0;
+	state->shards = NULL;
+	state->min_interval = REFRESH_RATE;
+	state->max_interval = MAX_REFRESH_RATE;
+	state->shm = NULL;
+	state->alerts = NULL;
+	state->control_path = NULL;
+	state->control_fd = -1;
+	state->control_thread = 0;
 	return state;
 }
 
@@ -58,7 +82,10 @@ void unlock_state(State * state) {
 
 void mark_ready(State * state) {
 	pthread_mutex_lock(&state->mState);
-	state->ready = 1;
+	if (state->ready >= 0) {
+		state->ready = 1;
+		++state->version;
+	}
 	pthread_mutex_unlock(&state->mState);
 }
 
@@ -75,6 +102,15 @@ void copy_state(State * target, State * source, int clear_ready) {
 	pthread_mutex_lock(&target->mState);
 	pthread_mutex_lock(&source->mState);
 
+	// Readers that leave ready set share the source, so they only copy versions they have not seen
+	if (!clear_ready && target->version == source->version) {
+		target->ready = 0;
+		pthread_mutex_unlock(&source->mState);
+		pthread_mutex_unlock(&target->mState);
+		return;
+	}
+	unsigned long seen = target->version;
+	target->version = source->version;
 	target->ready = source->ready;
 	if (clear_ready) source->ready = 0;
 	if (target->ready <= 0) {
@@ -83,79 +119,111 @@ void copy_state(State * target, State * source, int clear_ready) {
 		return;
 	}
 
-	target->message = source->message;
-	target->clockid = source->clockid;
-
-	if (target->num_instruments != source->num_instruments) {
-		target->num_instruments = source->num_instruments;
-		if (target->instruments) {
-			free(target->instruments);
-		}
-		if (!(target->instruments = calloc(source->num_instruments, sizeof(Instrument_State)))) {
-			target->num_instruments = 0;
-		}
+	if (target->num_instruments != source->num_instruments && resize_instruments(target, source->num_instruments)) {
+		target->ready = 0;
+		pthread_mutex_unlock(&source->mState);
+		pthread_mutex_unlock(&target->mState);
+		return;
 	}
 
+	// Only slots that were updated, added or refilled since the last copy are touched
 	int i;
 	for (i = 0; i < target->num_instruments; ++i) {
 		Instrument_State * source_i = &source->instruments[i];
 		Instrument_State * target_i = &target->instruments[i];
-		strcpy(target_i->instrument, source_i->instrument);
+		if (!(target_i->changed = source_i->version > seen)) continue;
+		if (strcmp(target_i->instrument, source_i->instrument)) {
+			strcpy(target_i->instrument, source_i->instrument);
+			target_i->replaced = 1;
+		}
 		target_i->price = source_i->price;
 		target_i->direction = source_i->direction;
-		if (target_i->changed = source_i->changed) {
-			if (target_i->draw_state) {
-				target_i->draw_state = MAX_DRAW_STATE * 4 / 5;
-			} else {
-				target_i->draw_state = source_i->draw_state;
-			}
+		if (source_i->alert_state) target_i->alert_state = source_i->alert_state;
+		if (target_i->draw_state) {
+			target_i->draw_state = MAX_DRAW_STATE * 4 / 5;
+		} else {
+			target_i->draw_state = source_i->draw_state;
 		}
+		target_i->server_time = source_i->server_time;
+		target_i->receive_time = source_i->receive_time;
+		// Keeping the slot version lets a copy be the source of further copies
+		target_i->version = source_i->version;
 	}
 
 	pthread_mutex_unlock(&source->mState);
 	pthread_mutex_unlock(&target->mState);
 }
 
+void delete_shard(Poll_Shard * shard) {
+	if (shard->instruments) free(shard->instruments);
+	if (shard->message) delete_string(shard->message);
+	if (shard->clockid >= 0) close(shard->clockid);
+	destroy_scheduler(&shard->scheduler);
+	free(shard);
+}
+
 void delete_state(State * state) {
 	if (state) {
 		if (state->instruments) free(state->instruments);
-		if (state->message) delete_string(state->message);
+		if (state->index) free(state->index);
+		int i;
+		for (i = 0; i < state->num_shards; ++i) {
+			delete_shard(state->shards[i]);
+		}
+		if (state->shards) free(state->shards);
 		pthread_mutex_destroy(&state->mState);
-		if (state->clockid >= 0) close(state->clockid);
 		free(state);
 	}
 }
 
-unsigned long getID() {
-	unsigned long id;
-	pthread_mutex_lock(&mID);
-	id = ID;
-	pthread_mutex_unlock(&mID);
-	return id;
+// Arms the clock as a fixed-rate periodic timer, so fetch time does not stretch the period
+void start_clock(int clockid, long interval, long first) {
+	if (clockid < 0) return;
+	struct itimerspec ts;
+	ts.it_interval.tv_sec = interval / 1000000000L;
+	ts.it_interval.tv_nsec = interval % 1000000000L;
+	// A zero it_value would disarm the timer, so an overdue first tick fires right away
+	if (first < 1) first = 1;
+	ts.it_value.tv_sec = first / 1000000000L;
+	ts.it_value.tv_nsec = first % 1000000000L;
+	timerfd_settime(clockid, 0, &ts, NULL);
 }
 
-void setID(unsigned long id) {
-	pthread_mutex_lock(&mID);
-	ID = id;
-	pthread_mutex_unlock(&mID);
+static long clock_remaining(int clockid) {
+	struct itimerspec ts;
+	if (clockid < 0 || timerfd_gettime(clockid, &ts)) return 0;
+	return ts.it_value.tv_sec * 1000000000L + ts.it_value.tv_nsec;
 }
 
-void reset_clock(int clockid) {
-	if (clockid < 0) return;
-	struct itimerspec ts;
-	ts.it_interval.tv_sec = 0;
-	ts.it_interval.tv_nsec = 0;
-	ts.it_value.tv_sec = 0;
-	ts.it_value.tv_nsec = REFRESH_RATE;
-	timerfd_settime(clockid, 0, &ts, NULL);
+/*
+ * Re-arms the shard's timer if its scheduler now wants a meaningfully
+ * different interval. The scheduler works from smoothed averages, so small
+ * changes are ignored; otherwise the timer would be reset after nearly every
+ * poll. A re-armed timer keeps its phase: the next tick moves by the change
+ * in interval from the last tick, not from now. Both poll stages call this
+ * once they have recorded how a poll went, so the state lock keeps the armed
+ * interval in step with the latest decision.
+ */
+void rearm_shard(Poll_Shard * shard) {
+	lock_state(shard->state);
+	long next = scheduler_next_interval(&shard->scheduler);
+	long step = next > shard->interval ? next - shard->interval : shard->interval - next;
+	if (!shard->interval) {
+		start_clock(shard->clockid, next, next);
+		shard->interval = next;
+	} else if (step * 100 > shard->interval * REARM_THRESHOLD) {
+		start_clock(shard->clockid, next, clock_remaining(shard->clockid) - shard->interval + next);
+		shard->interval = next;
+	}
+	unlock_state(shard->state);
 }
 
 //-------------------------SETUP-----------------------
-struct json_object * create_json_request(int argc, char ** argv) {
+struct json_object * create_json_request(Poll_Shard * shard) {
 	struct json_object * conf_prices = json_object_new_array();
 	int i;
-	for (i = 0; i < argc; ++i) {
-		json_object_array_add(conf_prices, json_object_new_string(argv[i]));
+	for (i = 0; i < shard->num_instruments; ++i) {
+		json_object_array_add(conf_prices, json_object_new_string(shard->instruments[i]));
 	}
 
 	struct json_object * request_config = json_object_new_object();
@@ -168,7 +236,7 @@ unsigned long parse_setup_response(char * response) {
 	struct json_object * id_obj;
 	unsigned long id = 0;
 	if (result == NULL || !json_object_object_get_ex(result, "sessionId", &id_obj)) {
-		printf("Something went wrong in processing the string %s\n", response);
+		fprintf(stderr, "Something went wrong in processing the string %.*s\n", RESPONSE_EXCERPT, response);
 		if (result) json_object_put(result);
 	} else {
 		id = json_object_get_int64(id_obj);
@@ -179,148 +247,535 @@ unsigned long parse_setup_response(char * response) {
 
 //-------------------------STATE MANIPULATION----------------
 
-void setup_state(State * state, int argc, char ** argv, struct String * message) {
-	pthread_mutex_init(&state->mState, NULL);
-	pthread_mutex_lock(&state->mState);
-	state->ready = 0;
-	state->message = message;
-	state->num_instruments = argc;
-	state->instruments = calloc(argc, sizeof(Instrument_State));
-	int i;
-	for (i = 0; i < argc; ++i) {
-		Instrument_State * instrument = &state->instruments[i];
-		strcpy(instrument->instrument, *argv++);
-		instrument->price = 0;
-		instrument->draw_state = 0;
-		instrument->changed = 0;
-	}
-	state->clockid = timerfd_create(CLOCK_REALTIME, 0);
-	reset_clock(state->clockid);
-	pthread_mutex_unlock(&state->mState);
+static unsigned int hash_name(const char * name) {
+	unsigned int hash = 2166136261u;
+	while (*name) {
+		hash = (hash ^ (unsigned char)*name++) * 16777619u;
+	}
+	return hash;
 }
 
-void setup_instrument(State * state, const char * name, struct json_object * obj) {
-	pthread_mutex_lock(&state->mState);
-	int i;
-	for (i = 0; i < state->num_instruments; ++i) {
-		Instrument_State * instrument = &state->instruments[i];
-		if (strcmp(instrument->instrument, name) == 0) {
-			struct json_object * bid_price = NULL;
-			json_object_object_get_ex(obj, "bid", &bid_price);
-			struct json_object * ask_price = NULL;
-			json_object_object_get_ex(obj, "ask", &ask_price);
-
-			if (bid_price && ask_price) {
-				double price = (json_object_get_double(ask_price) + json_object_get_double(bid_price)) / 2;
-				if (price > instrument->price) {
-					instrument->direction = 'u';
-				} else {
-					instrument->direction = 'd';
-				}
-				instrument->price = price;
-				instrument->draw_state = MAX_DRAW_STATE;
-				instrument->changed = 1;
-			}
-			break;
-		}
+// Returns the index entry holding name, or the empty entry where it would be inserted
+static int * index_entry(State * state, const char * name) {
+	unsigned int mask = state->index_capacity - 1;
+	unsigned int i = hash_name(name) & mask;
+	while (state->index[i] && strcmp(state->instruments[state->index[i] - 1].instrument, name)) {
+		i = (i + 1) & mask;
 	}
-	pthread_mutex_unlock(&state->mState);
+	return &state->index[i];
 }
 
-void clear_state_changed(State * state) {
-	pthread_mutex_lock(&state->mState);
+// Backward-shift deletion, so lookups never need tombstones
+static void index_remove(State * state, int * entry) {
+	unsigned int mask = state->index_capacity - 1;
+	unsigned int i = entry - state->index;
+	unsigned int j = i;
+	for (;;) {
+		j = (j + 1) & mask;
+		if (!state->index[j]) break;
+		unsigned int k = hash_name(state->instruments[state->index[j] - 1].instrument) & mask;
+		if (i <= j ? i < k && k <= j : i < k || k <= j) continue;
+		state->index[i] = state->index[j];
+		i = j;
+	}
+	state->index[i] = 0;
+}
+
+static int rebuild_index(State * state) {
+	int index_capacity = MIN_CAPACITY * 2;
+	while (index_capacity < state->capacity * 2) index_capacity *= 2;
+	int * index = calloc(index_capacity, sizeof(int));
+	if (!index) return 1;
+	if (state->index) free(state->index);
+	state->index = index;
+	state->index_capacity = index_capacity;
+
 	int i;
 	for (i = 0; i < state->num_instruments; ++i) {
-		state->instruments[i].changed = 0;
+		*index_entry(state, state->instruments[i].instrument) = i + 1;
 	}
-	pthread_mutex_unlock(&state->mState);
+	return 0;
 }
 
-//------------------------POLL-------------------
+static int lookup_instrument(State * state, const char * name) {
+	if (!state->index) return -1;
+	return *index_entry(state, name) - 1;
+}
+
+// Grows the array geometrically, keeping every existing slot in place
+static int reserve_instruments(State * state, int capacity) {
+	if (capacity <= state->capacity) return 0;
+	int new_capacity = state->capacity ? state->capacity : MIN_CAPACITY;
+	while (new_capacity < capacity) new_capacity *= 2;
+	Instrument_State * instruments = realloc(state->instruments, new_capacity * sizeof(Instrument_State));
+	if (!instruments) return 1;
+	state->instruments = instruments;
+	state->capacity = new_capacity;
+	return state->index ? rebuild_index(state) : 0;
+}
 
-void send_poll_request(State * state, unsigned long id) {
+// Sets the instrument count of a copy target, clearing the slots it gains (the caller holds the lock)
+int resize_instruments(State * state, int num_instruments) {
+	if (reserve_instruments(state, num_instruments)) return 1;
+	if (num_instruments > state->num_instruments) {
+		memset(&state->instruments[state->num_instruments], 0,
+				(num_instruments - state->num_instruments) * sizeof(Instrument_State));
+	}
+	state->num_instruments = num_instruments;
+	return 0;
+}
+
+int add_instrument(State * state, const char * name) {
 	pthread_mutex_lock(&state->mState);
-	state->message = perform_curl(state->message, POLL_CALL, PORT, id, NULL);
-	if (!state->message->data) {
-		printf("Poll request got null response\n");
+	if ((!state->index && rebuild_index(state)) || lookup_instrument(state, name) >= 0
+			|| reserve_instruments(state, state->num_instruments + 1)) {
 		pthread_mutex_unlock(&state->mState);
-		return;
+		return -1;
 	}
-	struct json_object * poll_data = json_tokener_parse(state->message->data);
-	if (!poll_data) {
-		printf("The response string could not be parsed: %s\n", state->message->data);
+	int slot = state->num_instruments++;
+	Instrument_State * instrument = &state->instruments[slot];
+	memset(instrument, 0, sizeof(Instrument_State));
+	snprintf(instrument->instrument, sizeof(instrument->instrument), "%s", name);
+	instrument->version = state->version + 1;
+	*index_entry(state, instrument->instrument) = slot + 1;
+	pthread_mutex_unlock(&state->mState);
+	return slot;
+}
+
+int remove_instrument(State * state, const char * name) {
+	pthread_mutex_lock(&state->mState);
+	int slot = lookup_instrument(state, name);
+	if (slot < 0) {
 		pthread_mutex_unlock(&state->mState);
-		return;
+		return -1;
+	}
+	index_remove(state, index_entry(state, name));
+	int last = --state->num_instruments;
+	if (slot != last) {
+		Instrument_State * instrument = &state->instruments[slot];
+		*instrument = state->instruments[last];
+		instrument->version = state->version + 1;
+		*index_entry(state, instrument->instrument) = slot + 1;
 	}
 	pthread_mutex_unlock(&state->mState);
+	return slot;
+}
+
+// Splits NAME@group into the instrument name and the group of the shard that polls it
+static int split_instrument_spec(const char * spec, char * name, char * group) {
+	const char * at = strchr(spec, '@');
+	int length = at ? at - spec : strlen(spec);
+	snprintf(name, 16, "%.*s", length, spec);
+	snprintf(group, 16, "%s", at ? at + 1 : "");
+	return name[0] != 0;
+}
+
+Poll_Shard * new_shard(State * state, const char * group) {
+	Poll_Shard * shard = calloc(1, sizeof(Poll_Shard));
+	if (!shard) return NULL;
+	shard->state = state;
+	snprintf(shard->group, sizeof(shard->group), "%s", group);
+	shard->clockid = timerfd_create(CLOCK_MONOTONIC, 0);
+	init_scheduler(&shard->scheduler, state->min_interval, state->max_interval);
+	return shard;
+}
+
+static Poll_Shard * find_shard(State * state, const char * group) {
+	int i;
+	for (i = 0; i < state->num_shards; ++i) {
+		if (strcmp(state->shards[i]->group, group) == 0) return state->shards[i];
+	}
+	return NULL;
+}
+
+static int add_shard(State * state, Poll_Shard * shard) {
+	pthread_mutex_lock(&state->mState);
+	Poll_Shard ** shards = realloc(state->shards, (state->num_shards + 1) * sizeof(Poll_Shard *));
+	if (shards) {
+		state->shards = shards;
+		state->shards[state->num_shards++] = shard;
+	}
+	pthread_mutex_unlock(&state->mState);
+	return !shards;
+}
+
+static int add_shard_instrument(Poll_Shard * shard, const char * name) {
+	if (shard->num_instruments == shard->capacity) {
+		int capacity = shard->capacity ? shard->capacity * 2 : MIN_CAPACITY;
+		char (* instruments)[16] = realloc(shard->instruments, capacity * sizeof(*instruments));
+		if (!instruments) return 1;
+		shard->instruments = instruments;
+		shard->capacity = capacity;
+	}
+	strcpy(shard->instruments[shard->num_instruments++], name);
+	return 0;
+}
+
+static int remove_shard_instrument(Poll_Shard * shard, const char * name) {
+	int i;
+	for (i = 0; i < shard->num_instruments; ++i) {
+		if (strcmp(shard->instruments[i], name) == 0) {
+			strcpy(shard->instruments[i], shard->instruments[--shard->num_instruments]);
+			return 0;
+		}
+	}
+	return 1;
+}
 
+int setup_state(State * state, int argc, char ** argv) {
 	int i;
-	struct json_object * price_array;
-	if (json_object_object_get_ex(poll_data, "prices", &price_array) && json_object_get_array(price_array)) {
-		clear_state_changed(state);
-		for (i = 0; i < json_object_array_length(price_array); ++i) {
-			struct json_object * instrument = json_object_array_get_idx(price_array, i);
-			struct json_object * name_obj;
-			if (json_object_object_get_ex(instrument, "instrument", &name_obj)) {
-				setup_instrument(state, json_object_get_string(name_obj), instrument);
+	for (i = 0; i < argc; ++i) {
+		char name[16], group[16];
+		if (!split_instrument_spec(argv[i], name, group)) continue;
+
+		lock_state(state);
+		int exists = lookup_instrument(state, name) >= 0;
+		unlock_state(state);
+		if (exists) continue;
+
+		Poll_Shard * shard = find_shard(state, group);
+		if (!shard) {
+			if (!(shard = new_shard(state, group))) return 0;
+			if (add_shard(state, shard)) {
+				delete_shard(shard);
+				return 0;
 			}
 		}
+		if (add_shard_instrument(shard, name) || add_instrument(state, name) < 0) return 0;
+	}
+	return 1;
+}
+
+double get_monotonic_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Server timestamps are wall clock, so latency measured against them uses it too
+double get_wall_time() {
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void setup_instrument(State * state, const char * name, double bid, double ask, double server_time, double receive_time) {
+	Alert_Batch alerts;
+	alerts.num_fired = 0;
+	alerts.dropped = 0;
+	pthread_mutex_lock(&state->mState);
+	int slot = lookup_instrument(state, name);
+	if (slot >= 0) {
+		Instrument_State * instrument = &state->instruments[slot];
+		double price = (ask + bid) / 2;
+		if (state->alerts && check_alerts(state->alerts, &alerts, name, instrument->price, price, get_monotonic_time())) {
+			instrument->alert_state = ALERT_DRAW_STATE;
+		} else {
+			instrument->alert_state = 0;
+		}
+		if (price > instrument->price) {
+			instrument->direction = 'u';
+		} else {
+			instrument->direction = 'd';
+		}
+		instrument->price = price;
+		instrument->draw_state = MAX_DRAW_STATE;
+		instrument->changed = 1;
+		instrument->version = state->version + 1;
+		instrument->server_time = server_time;
+		instrument->receive_time = receive_time;
+	}
+	pthread_mutex_unlock(&state->mState);
+	if (state->alerts) run_alerts(state->alerts, &alerts);
+}
+
+//------------------------POLL-------------------
+
+typedef struct {
+	State * state;
+	double receive_time;
+} Poll_Response;
+
+static void apply_price(void * arg, const char * name, double time, double bid, double ask) {
+	Poll_Response * response = (Poll_Response *)arg;
+	setup_instrument(response->state, name, bid, ask, time, response->receive_time);
+}
+
+int apply_poll_response(State * state, const char * response, double receive_time) {
+	Poll_Response context = {state, receive_time};
+	int count = parse_prices(response, apply_price, &context);
+	if (count >= 0) {
 		mark_ready(state);
+		if (state->shm) publish_state(state->shm, state);
+	}
+	return count;
+}
+
+/*
+ * Each shard polls as two stages: poll_t fetches on every timer tick and
+ * hands the response buffer to apply_t, which parses and applies it. Buffers
+ * cycle between the two through a pair of queues, so the next request can be
+ * in flight while the previous response is still being applied. The timer is
+ * re-armed whenever the shard's scheduler picks a new interval.
+ */
+typedef struct {
+	Poll_Shard * shard;
+	Spsc_Queue filled;
+	Spsc_Queue empty;
+	struct String buffers[POLL_BUFFERS];
+	double receive_times[POLL_BUFFERS];
+} Poll_Pipeline;
+
+int fetch_poll_response(Poll_Shard * shard, unsigned long id, struct String * buffer, double * receive_time) {
+	double start = get_monotonic_time();
+	struct String * message = perform_curl(shard->message, POLL_CALL, PORT, id, NULL);
+	if (!message || !message->data) {
+		fprintf(stderr, "Poll request got null response\n");
+		scheduler_record_failure(&shard->scheduler);
+		return 0;
 	}
-	json_object_put(poll_data);
+	scheduler_record_latency(&shard->scheduler, get_monotonic_time() - start);
+	*receive_time = get_wall_time();
+	shard->message = message;
+	swap_string_data(message, buffer);
+	return 1;
+}
+
+void * apply_t(void * arg) {
+	Poll_Pipeline * pipeline = (Poll_Pipeline *)arg;
+	Poll_Shard * shard = pipeline->shard;
+	State * state = shard->state;
+	while (is_ready(state) >= 0) {
+		struct String * buffer = spsc_pop(&pipeline->filled, SHUTDOWN_CHECK);
+		if (!buffer) continue;
+		int count = apply_poll_response(state, buffer->data, pipeline->receive_times[buffer - pipeline->buffers]);
+		if (count < 0) {
+			fprintf(stderr, "The response string could not be parsed: %.*s\n", RESPONSE_EXCERPT, buffer->data);
+			scheduler_record_failure(&shard->scheduler);
+		} else {
+			lock_state(state);
+			int num_instruments = shard->num_instruments;
+			unlock_state(state);
+			scheduler_record_changes(&shard->scheduler, count, num_instruments);
+		}
+		rearm_shard(shard);
+		spsc_push(&pipeline->empty, buffer, -1);
+	}
+	return NULL;
 }
 
 void * poll_t(void * arg) {
+	Poll_Shard * shard = (Poll_Shard *)arg;
+	State * state = shard->state;
+	Poll_Pipeline pipeline;
+	pipeline.shard = shard;
+	if (init_spsc_queue(&pipeline.filled, POLL_BUFFERS)) return NULL;
+	if (init_spsc_queue(&pipeline.empty, POLL_BUFFERS)) {
+		destroy_spsc_queue(&pipeline.filled);
+		return NULL;
+	}
+	int i;
+	for (i = 0; i < POLL_BUFFERS; ++i) {
+		memset(&pipeline.buffers[i], 0, sizeof(struct String));
+		spsc_push(&pipeline.empty, &pipeline.buffers[i], -1);
+	}
+
+	pthread_t apply_thread;
+	if (pthread_create(&apply_thread, NULL, apply_t, &pipeline)) {
+		apply_thread = 0;
+	}
+
+	rearm_shard(shard);
+
 	struct pollfd pfd;
-	int ready;
-	State * state = (State *)arg;
-	while ((ready = is_ready(state)) >= 0) {
-		pfd.fd = state->clockid;
-		pfd.events = POLLIN;
-		if (poll(&pfd, 1, 0)) {
-			send_poll_request(state, getID());
-			reset_clock(state->clockid);
+	pfd.fd = shard->clockid;
+	pfd.events = POLLIN;
+	while (apply_thread && is_ready(state) >= 0) {
+		if (poll(&pfd, 1, SHUTDOWN_CHECK) <= 0) continue;
+
+		uint64_t expirations;
+		if (read(shard->clockid, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+		if (expirations > 1) fprintf(stderr, "Poll fell behind by %lu ticks\n", (unsigned long)(expirations - 1));
+
+		// The session changes when instruments are added or removed; a shard left empty idles
+		lock_state(state);
+		unsigned long id = shard->id;
+		unlock_state(state);
+		if (!id) continue;
+
+		// If every buffer is still waiting to be applied, skip this tick; the next poll catches up
+		struct String * buffer = spsc_pop(&pipeline.empty, 0);
+		if (!buffer) continue;
+		// A fetched buffer is judged by apply_t, which re-arms the timer once it knows whether it parsed
+		if (fetch_poll_response(shard, id, buffer, &pipeline.receive_times[buffer - pipeline.buffers])) {
+			spsc_push(&pipeline.filled, buffer, -1);
+		} else {
+			spsc_push(&pipeline.empty, buffer, -1);
+			rearm_shard(shard);
 		}
 	}
+
+	if (apply_thread) pthread_join(apply_thread, NULL);
+	for (i = 0; i < POLL_BUFFERS; ++i) {
+		if (pipeline.buffers[i].data) free(pipeline.buffers[i].data);
+	}
+	destroy_spsc_queue(&pipeline.filled);
+	destroy_spsc_queue(&pipeline.empty);
 	return NULL;
 }
 
-//----------------------"MAIN"-----------------
-pthread_t setup_state_and_poll_thread(State * state, int argc, char ** argv) {
-	if (!state) return 0;
+// Reads "min_ms,max_ms" (or a single value for a fixed rate) into the scheduler bounds used by new shards
+int set_poll_intervals(State * state, const char * spec) {
+	long min_ms, max_ms;
+	int n = sscanf(spec, "%ld,%ld", &min_ms, &max_ms);
+	if (n == 1) max_ms = min_ms;
+	if (n < 1 || min_ms <= 0 || max_ms < min_ms) {
+		fprintf(stderr, "Invalid poll interval '%s', expected min_ms,max_ms\n", spec);
+		return 1;
+	}
+	state->min_interval = min_ms * 1000000L;
+	state->max_interval = max_ms * 1000000L;
+	return 0;
+}
 
-	unsigned long id = ID;
-	if (id) {
-		setup_state(state, argc, argv, NULL);
-	} else {
-		struct json_object * request_config = create_json_request(argc, argv);
+//----------------------SUBSCRIPTIONS-----------------
+unsigned long open_session(Poll_Shard * shard) {
+	struct json_object * request_config = create_json_request(shard);
+	struct String * message = perform_curl(NULL, POLL_CALL, PORT, 0, request_config);
+	json_object_put(request_config);
 
-		struct String * message = perform_curl(NULL, POLL_CALL, PORT, 0, request_config);
-		json_object_put(request_config);
+	if (!message) {
+		fprintf(stderr, "Could not obtain message for shard '%s'\n", shard->group);
+		return 0;
+	}
+	unsigned long id = parse_setup_response(message->data);
+	delete_string(message);
+	return id;
+}
 
-		setup_state(state, argc, argv, message);
+static void start_shard(Poll_Shard * shard) {
+	if (pthread_create(&shard->thread, NULL, poll_t, shard)) {
+		shard->thread = 0;
+		fprintf(stderr, "Could not start the poll thread for shard '%s'\n", shard->group);
+	}
+}
 
-		if (!message) {
-			printf("Could not obtain message, exiting\n");
-			return 0;
+/*
+ * Subscriptions change one shard at a time: the shard opens a new session
+ * for its updated instrument list and swaps it in once it exists, so the
+ * other shards and the untouched slots of the state are left alone. Both
+ * calls are made from the control thread only.
+ */
+int subscribe_instrument(State * state, const char * spec) {
+	char name[16], group[16];
+	if (!split_instrument_spec(spec, name, group)) return 1;
+
+	lock_state(state);
+	int exists = lookup_instrument(state, name) >= 0;
+	int full = state->shm && state->num_instruments >= state->shm->layout->capacity;
+	Poll_Shard * shard = find_shard(state, group);
+	unlock_state(state);
+	if (exists) {
+		fprintf(stderr, "%s is already subscribed\n", name);
+		return 1;
+	}
+	// Readers only see as many instruments as the segment was sized for
+	if (full) {
+		fprintf(stderr, "Shared memory segment %s is full, not subscribing %s\n", state->shm->name, name);
+		return 1;
+	}
+
+	Poll_Shard * created = NULL;
+	if (!shard && !(shard = created = new_shard(state, group))) return 1;
+
+	lock_state(state);
+	int failed = add_shard_instrument(shard, name);
+	unlock_state(state);
+
+	unsigned long id = failed ? 0 : open_session(shard);
+	if (!id) {
+		if (created) {
+			delete_shard(created);
+		} else {
+			lock_state(state);
+			remove_shard_instrument(shard, name);
+			unlock_state(state);
 		}
+		return 1;
+	}
 
-		id = parse_setup_response(message->data);
+	// The slot exists before the new session can report a price for it
+	if (add_instrument(state, name) < 0 || (created && add_shard(state, created))) {
+		remove_instrument(state, name);
+		if (created) delete_shard(created);
+		return 1;
+	}
+	lock_state(state);
+	shard->id = id;
+	unlock_state(state);
+	if (created) start_shard(created);
+
+	mark_ready(state);
+	if (state->shm) publish_state(state->shm, state);
+	return 0;
+}
 
-		pthread_mutex_init(&mID, NULL);
-		setID(id);
+int unsubscribe_instrument(State * state, const char * name) {
+	Poll_Shard * shard = NULL;
+	lock_state(state);
+	int i;
+	for (i = 0; i < state->num_shards && !shard; ++i) {
+		if (!remove_shard_instrument(state->shards[i], name)) shard = state->shards[i];
+	}
+	int remaining = shard ? shard->num_instruments : 0;
+	unlock_state(state);
+	if (!shard) {
+		fprintf(stderr, "%s is not subscribed\n", name);
+		return 1;
 	}
 
-	pthread_t thread = 0;
+	unsigned long id = remaining ? open_session(shard) : 0;
+	if (remaining && !id) {
+		lock_state(state);
+		add_shard_instrument(shard, name);
+		unlock_state(state);
+		return 1;
+	}
 
-	if (!id) {
-		printf("No ID was retrieved from the response\n");
-	} else {
-		if (pthread_create(&thread, NULL, poll_t, state)) {
-			thread = 0;
+	lock_state(state);
+	shard->id = id;
+	unlock_state(state);
+	remove_instrument(state, name);
+
+	mark_ready(state);
+	if (state->shm) publish_state(state->shm, state);
+	return 0;
+}
+
+//----------------------"MAIN"-----------------
+pthread_t setup_state_and_poll_thread(State * state, int argc, char ** argv) {
+	if (!state) return 0;
+
+	if (!setup_state(state, argc, argv)) {
+		fprintf(stderr, "Could not set up state for %d instruments\n", argc);
+		return 0;
+	}
+
+	// Open every session before starting any thread, so a failure leaves nothing to join
+	int i;
+	for (i = 0; i < state->num_shards; ++i) {
+		Poll_Shard * shard = state->shards[i];
+		if (!(shard->id = open_session(shard))) {
+			fprintf(stderr, "No ID was retrieved from the response\n");
+			return 0;
 		}
 	}
-	return thread;
+	if (state->control_path && !(state->control_thread = setup_control_thread(state))) return 0;
+
+	for (i = 0; i < state->num_shards; ++i) {
+		start_shard(state->shards[i]);
+	}
+	return state->num_shards ? state->shards[0]->thread : 0;
 }
 
 void destroy_state_and_poll_thread(State * state, pthread_t thread) {
@@ -328,5 +783,12 @@ void destroy_state_and_poll_thread(State * state, pthread_t thread) {
 	state->ready = -1;
 	pthread_mutex_unlock(&state->mState);
 	if (thread) pthread_join(thread, NULL);
+	// Subscription changes add shards, so the control thread has to stop before they are collected
+	if (state->control_thread) pthread_join(state->control_thread, NULL);
+	int i;
+	for (i = 0; i < state->num_shards; ++i) {
+		pthread_t shard_thread = state->shards[i]->thread;
+		if (shard_thread && !pthread_equal(shard_thread, thread)) pthread_join(shard_thread, NULL);
+	}
 	delete_state(state);
 }
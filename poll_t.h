@@ -3,6 +3,7 @@
 
 #include <pthread.h>
 #include "s_string.h"
+#include "scheduler.h"
 
 #define MAX_DRAW_STATE 60
 
@@ -12,15 +13,54 @@ typedef struct {
 	char direction;
 	int draw_state;
 	char changed;
+	char replaced;
+	int alert_state;
+	unsigned long version;
+	double server_time;
+	double receive_time;
 } Instrument_State;
 
+/*
+ * Instruments given as NAME@group are polled by the shard for that group,
+ * with its own session, timer and scheduler; plain names share the default
+ * shard.
+ */
 typedef struct {
+	struct State * state;
+	char group[16];
 	int num_instruments;
+	int capacity;
+	char (* instruments)[16];
+	unsigned long id;
+	int clockid;
+	long interval;
+	struct String * message;
+	Poll_Scheduler scheduler;
+	pthread_t thread;
+} Poll_Shard;
+
+/*
+ * Instruments are kept in a growable array with an open-addressing name
+ * index (slot + 1 per entry, 0 for empty). Removing an instrument moves the
+ * last one into its slot, so every other slot keeps its position.
+ */
+typedef struct State {
+	int num_instruments;
+	int capacity;
 	Instrument_State * instruments;
+	int * index;
+	int index_capacity;
 	pthread_mutex_t mState;
 	int ready;
-	struct String * message;
-	int clockid;
+	unsigned long version;
+	int num_shards;
+	Poll_Shard ** shards;
+	long min_interval, max_interval;
+	struct Shm_State * shm;
+	struct Alert_Rules * alerts;
+	const char * control_path;
+	int control_fd;
+	pthread_t control_thread;
 } State;
 
 //State * getState(int clear);
@@ -28,8 +68,19 @@ State * new_state();
 void delete_state(State * state);
 void lock_state(State * state);
 void unlock_state(State * state);
+void mark_ready(State * state);
 int is_ready(State * state);
 void copy_state(State * target, State * source, int clear_ready);
+int resize_instruments(State * state, int num_instruments);
+int add_instrument(State * state, const char * name);
+int remove_instrument(State * state, const char * name);
+void setup_instrument(State * state, const char * name, double bid, double ask, double server_time, double receive_time);
+int apply_poll_response(State * state, const char * response, double receive_time);
+double get_monotonic_time();
+double get_wall_time();
+int set_poll_intervals(State * state, const char * spec);
+int subscribe_instrument(State * state, const char * spec);
+int unsubscribe_instrument(State * state, const char * name);
 pthread_t setup_state_and_poll_thread(State * state, int argc, char ** argv);
 void destroy_state_and_poll_thread(State * state, pthread_t thread);
 
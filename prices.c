@@ -0,0 +1,189 @@
+#include <stdlib.h>
+#include <string.h>
+#include "prices.h"
+
+#define MAX_DEPTH 32
+#define KEY_LENGTH 16
+#define TIME_LENGTH 40
+
+static const char * skip_ws(const char * p) {
+	while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') ++p;
+	return p;
+}
+
+// Copies the string starting at p (which must point at the opening quote) into out, truncating to size
+static const char * read_string(const char * p, char * out, size_t size) {
+	if (*p++ != '"') return NULL;
+	size_t length = 0;
+	while (*p && *p != '"') {
+		if (*p == '\\' && !*++p) return NULL;
+		if (out && length + 1 < size) out[length++] = *p;
+		++p;
+	}
+	if (out && size) out[length] = 0;
+	return *p == '"' ? p + 1 : NULL;
+}
+
+static const char * skip_value(const char * p, int depth) {
+	if (depth > MAX_DEPTH) return NULL;
+	p = skip_ws(p);
+	if (*p == '"') return read_string(p, NULL, 0);
+	if (*p == '{' || *p == '[') {
+		char close = *p == '{' ? '}' : ']';
+		p = skip_ws(p + 1);
+		if (*p == close) return p + 1;
+		for (;;) {
+			if (close == '}') {
+				if (!(p = read_string(skip_ws(p), NULL, 0))) return NULL;
+				p = skip_ws(p);
+				if (*p++ != ':') return NULL;
+			}
+			if (!(p = skip_value(p, depth + 1))) return NULL;
+			p = skip_ws(p);
+			if (*p == close) return p + 1;
+			if (*p++ != ',') return NULL;
+		}
+	}
+	const char * start = p;
+	while (*p && !strchr(",}] \t\r\n", *p)) ++p;
+	return p > start ? p : NULL;
+}
+
+static const char * read_digits(const char * p, int count, int * value) {
+	*value = 0;
+	while (count--) {
+		if (*p < '0' || *p > '9') return NULL;
+		*value = *value * 10 + *p++ - '0';
+	}
+	return p;
+}
+
+/*
+ * Converts an RFC 3339 UTC timestamp (2014-06-13T14:20:09.414002Z) or a count
+ * of microseconds since the epoch to seconds since the epoch, or 0 if the
+ * format is not recognized.
+ */
+static double parse_time(const char * text) {
+	int year, month, day, hour, minute, second;
+	const char * p = text;
+	if (!(p = read_digits(p, 4, &year)) || *p++ != '-') {
+		char * end;
+		double value = strtod(text, &end);
+		return end > text && !*end ? value / 1e6 : 0;
+	}
+	if (!(p = read_digits(p, 2, &month)) || *p++ != '-' || !(p = read_digits(p, 2, &day)) || *p++ != 'T'
+			|| !(p = read_digits(p, 2, &hour)) || *p++ != ':' || !(p = read_digits(p, 2, &minute)) || *p++ != ':'
+			|| !(p = read_digits(p, 2, &second))) {
+		return 0;
+	}
+	double fraction = 0, scale = 1;
+	if (*p == '.') {
+		while (*++p >= '0' && *p <= '9') {
+			fraction = fraction * 10 + *p - '0';
+			scale *= 10;
+		}
+	}
+	if (*p != 'Z') return 0;
+
+	// Days since 1970-01-01 in the proleptic Gregorian calendar, with years starting in March
+	year -= month <= 2;
+	long era = (year >= 0 ? year : year - 399) / 400;
+	long year_of_era = year - era * 400;
+	long day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	long day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+	long days = era * 146097 + day_of_era - 719468;
+	return days * 86400.0 + hour * 3600 + minute * 60 + second + fraction / scale;
+}
+
+static const char * parse_price(const char * p, Price_Callback callback, void * arg, int * count) {
+	char instrument[KEY_LENGTH] = {0};
+	double time = 0, bid = 0, ask = 0;
+	int have_bid = 0, have_ask = 0;
+
+	p = skip_ws(p);
+	if (*p != '{') return skip_value(p, 1);
+	p = skip_ws(p + 1);
+	if (*p == '}') return p + 1;
+
+	for (;;) {
+		char key[KEY_LENGTH];
+		if (!(p = read_string(skip_ws(p), key, sizeof(key)))) return NULL;
+		p = skip_ws(p);
+		if (*p++ != ':') return NULL;
+		p = skip_ws(p);
+
+		if (!strcmp(key, "instrument") && *p == '"') {
+			p = read_string(p, instrument, sizeof(instrument));
+		} else if (!strcmp(key, "time") && *p == '"') {
+			char text[TIME_LENGTH];
+			if ((p = read_string(p, text, sizeof(text)))) time = parse_time(text);
+		} else if (!strcmp(key, "bid") || !strcmp(key, "ask")) {
+			char * end;
+			double value = strtod(p, &end);
+			if (end == p) return NULL;
+			if (key[0] == 'b') {
+				bid = value;
+				have_bid = 1;
+			} else {
+				ask = value;
+				have_ask = 1;
+			}
+			p = end;
+		} else {
+			p = skip_value(p, 2);
+		}
+		if (!p) return NULL;
+
+		p = skip_ws(p);
+		if (*p == '}') break;
+		if (*p++ != ',') return NULL;
+	}
+
+	if (instrument[0] && have_bid && have_ask) {
+		callback(arg, instrument, time, bid, ask);
+		++*count;
+	}
+	return p + 1;
+}
+
+int parse_prices(const char * data, Price_Callback callback, void * arg) {
+	if (!data) return -1;
+	const char * p = skip_ws(data);
+	if (*p++ != '{') return -1;
+	p = skip_ws(p);
+	if (*p == '}') return -1;
+
+	int count = -1;
+	for (;;) {
+		char key[KEY_LENGTH];
+		if (!(p = read_string(skip_ws(p), key, sizeof(key)))) return -1;
+		p = skip_ws(p);
+		if (*p++ != ':') return -1;
+		p = skip_ws(p);
+
+		if (!strcmp(key, "prices") && *p == '[') {
+			count = 0;
+			p = skip_ws(p + 1);
+			if (*p == ']') {
+				++p;
+			} else {
+				for (;;) {
+					if (!(p = parse_price(p, callback, arg, &count))) return -1;
+					p = skip_ws(p);
+					if (*p == ']') {
+						++p;
+						break;
+					}
+					if (*p++ != ',') return -1;
+				}
+			}
+		} else if (!(p = skip_value(p, 1))) {
+			return -1;
+		}
+
+		p = skip_ws(p);
+		if (*p == '}') break;
+		if (*p++ != ',') return -1;
+	}
+	return count;
+}
@@ -0,0 +1,15 @@
+#ifndef PRICES
+#define PRICES
+
+typedef void (*Price_Callback)(void * arg, const char * instrument, double time, double bid, double ask);
+
+/*
+ * Scans a poll response ({"prices":[{"instrument":..., "time":..., "bid":..., "ask":...}, ...]})
+ * in place and calls callback for every complete entry. time is the server
+ * timestamp in seconds since the epoch, or 0 if the entry has none. Does not
+ * allocate. Returns the number of entries reported, or -1 if the response is
+ * malformed.
+ */
+int parse_prices(const char * data, Price_Callback callback, void * arg);
+
+#endif
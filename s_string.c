@@ -4,34 +4,45 @@
 #include <string.h>
 #include "s_string.h"
 
-static size_t write_func(char * ptr, size_t size, size_t nmemb, void * userdata) {
+#define URL_LENGTH 256
+
+size_t write_func(char * ptr, size_t size, size_t nmemb, void * userdata) {
 	struct String * str = (struct String *) userdata;
-	if (str->data == NULL) {
-		str->data = (char *)malloc(size * (nmemb + 1));
-		str->length = 0;
-		str->capacity = size * (nmemb + 1);
-		if (str->data == NULL) {
-			printf("Error in allocating String data memory");
+	size_t chunk = size * nmemb;
+	size_t required = str->length + chunk + 1;
+	if (required > str->capacity) {
+		size_t capacity = str->capacity ? str->capacity : required;
+		while (capacity < required) capacity *= 2;
+		char * new_data = (char *)realloc(str->data, capacity);
+		if (!new_data) {
+			fprintf(stderr, "Error in allocating String data memory\n");
 			return 0;
 		}
+		str->data = new_data;
+		str->capacity = capacity;
 	}
 
-	size_t new_length = str->length + size * (nmemb + 1);
-	while (new_length > str->capacity) {
-		if ((str->capacity *= 2) >= new_length) {
-			char * new_data = (char *)realloc(str->data, str->capacity);
-			if (!new_data) {
-				printf("Error in reallocating String data memory");
-				return 0;
-			}
-			str->data = new_data;
-		}
-	}
+	memcpy(str->data + str->length, ptr, chunk);
+	str->length += chunk;
+	str->data[str->length] = 0;
+	return chunk;
+}
 
-	memcpy(str->data + str->length, ptr, size * nmemb);
-	memset(str->data + str->length + size * nmemb, 0, size);
-	str->length += size * nmemb;
-	return size * nmemb;
+// Empties the string but keeps its buffer, so a response of the same size needs no allocation
+void reset_string(struct String * s) {
+	s->length = 0;
+	if (s->data) s->data[0] = 0;
+}
+
+// Exchanges the buffers of two strings, leaving their curl handles in place
+void swap_string_data(struct String * a, struct String * b) {
+	struct String t = *a;
+	a->data = b->data;
+	a->length = b->length;
+	a->capacity = b->capacity;
+	b->data = t.data;
+	b->length = t.length;
+	b->capacity = t.capacity;
 }
 
 struct String * perform_curl(struct String * m, char * url, unsigned long port, unsigned long sessionId, struct json_object * config) {
@@ -39,23 +50,24 @@ struct String * perform_curl(struct String * m, char * url, unsigned long port,
 	if (!message) {
 		message = (struct String *)malloc(sizeof(struct String));
 		if (!message) {
-			printf("Error in allocating initial String memory");
+			fprintf(stderr, "Error in allocating initial String memory\n");
 			return NULL;
 		}
 		message->data = NULL;
+		message->length = 0;
+		message->capacity = 0;
+		message->handle = NULL;
 	}
-	if (message->data) {
-		free(message->data);
-		message->data = NULL;
-	}
+	reset_string(message);
 
-	CURL * curl = curl_easy_init();
-	if (!curl) {
-		free(message);
+	// The easy handle is kept with the buffer so its connection is reused between polls
+	if (!message->handle && !(message->handle = curl_easy_init())) {
+		if (!m) delete_string(message);
 		return NULL;
 	}
+	CURL * curl = message->handle;
 
-	char * fullurl = url;
+	char fullurl[URL_LENGTH];
 	curl_easy_setopt(curl, CURLOPT_PORT, port);
 	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, &write_func);
 	curl_easy_setopt(curl, CURLOPT_WRITEDATA, message);
@@ -65,37 +77,35 @@ struct String * perform_curl(struct String * m, char * url, unsigned long port,
 		const char * post_message = json_object_to_json_string(config);
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDS, post_message);
 		curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE, strlen(post_message));
+		curl_easy_setopt(curl, CURLOPT_URL, url);
 	} else {
-		fullurl = (char *)malloc(2 * strlen(url));
-		snprintf(fullurl, 2 * strlen(url) -1, "%s?sessionId=%lu", url, sessionId);
+		curl_easy_setopt(curl, CURLOPT_HTTPGET, 1);
+		snprintf(fullurl, sizeof(fullurl), "%s?sessionId=%lu", url, sessionId);
+		curl_easy_setopt(curl, CURLOPT_URL, fullurl);
 	}
-	curl_easy_setopt(curl, CURLOPT_URL, fullurl);
 
 	CURLcode status = curl_easy_perform(curl);
-	if (fullurl != url) {
-		free(fullurl);
-	}
 	if (status) {
-		printf("Error occurred in performing curl: %s\n", curl_easy_strerror(status));
-		curl_easy_cleanup(curl);
+		fprintf(stderr, "Error occurred in performing curl: %s\n", curl_easy_strerror(status));
+		if (!m) delete_string(message);
 		return NULL;
 	}
 
 	long int code;
 	curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
 	if (code != 200) {
-		printf("Server returned error code: %ld\n", code);
-		curl_easy_cleanup(curl);
+		fprintf(stderr, "Server returned error code: %ld\n", code);
+		if (!m) delete_string(message);
 		return NULL;
 	}
 
-	curl_easy_cleanup(curl);
 	return message;
 }
 
 void delete_string(struct String * s) {
 	if (s) {
 		if (s->data) free(s->data);
+		if (s->handle) curl_easy_cleanup(s->handle);
 		free(s);
 	}
 }
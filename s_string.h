@@ -7,9 +7,14 @@ struct String {
 	char * data;
 	size_t length;
 	size_t capacity;
+	void * handle;
 };
 
 void delete_string(struct String * s);
+void reset_string(struct String * s);
+void swap_string_data(struct String * a, struct String * b);
+
+size_t write_func(char * ptr, size_t size, size_t nmemb, void * userdata);
 
 struct String * perform_curl(struct String * m, char * url, unsigned long port, unsigned long sessionId, struct json_object * config);
 
@@ -0,0 +1,69 @@
+#include "scheduler.h"
+
+#define CHANGE_SMOOTHING 0.3
+#define LATENCY_SMOOTHING 0.2
+#define BUSY_CHANGE_RATE 0.5
+#define LATENCY_FACTOR 2
+#define MAX_BACKOFF 30000000000L
+#define MAX_BACKOFF_SHIFT 16
+
+void init_scheduler(Poll_Scheduler * scheduler, long min_interval, long max_interval) {
+	scheduler->min_interval = min_interval;
+	scheduler->max_interval = max_interval > min_interval ? max_interval : min_interval;
+	// Start as if busy, so the first polls after startup run at the fastest rate
+	scheduler->change_rate = BUSY_CHANGE_RATE;
+	scheduler->latency = 0;
+	scheduler->failures = 0;
+	pthread_mutex_init(&scheduler->mScheduler, NULL);
+}
+
+void destroy_scheduler(Poll_Scheduler * scheduler) {
+	pthread_mutex_destroy(&scheduler->mScheduler);
+}
+
+void scheduler_record_changes(Poll_Scheduler * scheduler, int num_changed, int num_instruments) {
+	if (num_instruments <= 0) return;
+	double rate = (double)num_changed / num_instruments;
+	pthread_mutex_lock(&scheduler->mScheduler);
+	scheduler->change_rate += CHANGE_SMOOTHING * (rate - scheduler->change_rate);
+	scheduler->failures = 0;
+	pthread_mutex_unlock(&scheduler->mScheduler);
+}
+
+void scheduler_record_latency(Poll_Scheduler * scheduler, double seconds) {
+	pthread_mutex_lock(&scheduler->mScheduler);
+	if (scheduler->latency) {
+		scheduler->latency += LATENCY_SMOOTHING * (seconds - scheduler->latency);
+	} else {
+		scheduler->latency = seconds;
+	}
+	pthread_mutex_unlock(&scheduler->mScheduler);
+}
+
+void scheduler_record_failure(Poll_Scheduler * scheduler) {
+	pthread_mutex_lock(&scheduler->mScheduler);
+	++scheduler->failures;
+	pthread_mutex_unlock(&scheduler->mScheduler);
+}
+
+long scheduler_next_interval(Poll_Scheduler * scheduler) {
+	pthread_mutex_lock(&scheduler->mScheduler);
+	long interval;
+	if (scheduler->failures) {
+		int shift = scheduler->failures < MAX_BACKOFF_SHIFT ? scheduler->failures : MAX_BACKOFF_SHIFT;
+		interval = scheduler->min_interval << shift;
+		long cap = scheduler->max_interval > MAX_BACKOFF ? scheduler->max_interval : MAX_BACKOFF;
+		if (interval > cap || interval <= 0) interval = cap;
+	} else {
+		double busy = scheduler->change_rate / BUSY_CHANGE_RATE;
+		if (busy > 1) busy = 1;
+		interval = scheduler->max_interval - (scheduler->max_interval - scheduler->min_interval) * busy;
+
+		long floor = scheduler->latency * LATENCY_FACTOR * 1e9;
+		if (interval < floor) interval = floor;
+		if (interval < scheduler->min_interval) interval = scheduler->min_interval;
+		if (interval > scheduler->max_interval) interval = scheduler->max_interval;
+	}
+	pthread_mutex_unlock(&scheduler->mScheduler);
+	return interval;
+}
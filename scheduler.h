@@ -0,0 +1,29 @@
+#ifndef SCHEDULER
+#define SCHEDULER
+
+#include <pthread.h>
+
+/*
+ * Chooses the poll interval of one shard between min_interval and
+ * max_interval (nanoseconds): busier shards, where a larger fraction of
+ * instruments changes per poll, are polled faster; the interval never drops
+ * below a multiple of the observed round trip, and consecutive failures back
+ * off exponentially. A fetch that succeeds but cannot be parsed still counts
+ * as a failure, so only recording changes from an applied poll clears them.
+ */
+typedef struct {
+	long min_interval, max_interval;
+	double change_rate;
+	double latency;
+	int failures;
+	pthread_mutex_t mScheduler;
+} Poll_Scheduler;
+
+void init_scheduler(Poll_Scheduler * scheduler, long min_interval, long max_interval);
+void destroy_scheduler(Poll_Scheduler * scheduler);
+void scheduler_record_changes(Poll_Scheduler * scheduler, int num_changed, int num_instruments);
+void scheduler_record_latency(Poll_Scheduler * scheduler, double seconds);
+void scheduler_record_failure(Poll_Scheduler * scheduler);
+long scheduler_next_interval(Poll_Scheduler * scheduler);
+
+#endif
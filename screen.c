@@ -1,5 +1,7 @@
 #include <curl/curl.h>
 #include <X11/Xlib.h>
+#define GL_GLEXT_PROTOTYPES
+#include <X11/extensions/Xrandr.h>
 #include <GL/glx.h>
 #include <GL/gl.h>
 #include <stdio.h>
@@ -7,7 +9,12 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <unistd.h>
 #include "poll_t.h"
+#include "grid.h"
+#include "perf_stats.h"
+#include "shm_state.h"
+#include "alerts.h"
 
 #define SHOW_TEXT
 #define FULLSCREEN
@@ -15,6 +22,21 @@
 
 #define T_BOUND 0.5
 #define T_BOTTOM_BRIGHTNESS 0.3
+#define A_BOUND 0.95
+
+#define H_PERCENT_RANGE 0.5
+// Change stamps are 16 bits; the top value marks a slot whose flash has finished
+#define H_FRAME_WRAP 65535
+#define H_EXPIRED 65535
+#define H_EXPIRE_SWEEP 1024
+// A stamp stays live until both the change flash and an alert outline have faded
+#define H_FLASH_FRAMES (ALERT_DRAW_STATE > MAX_DRAW_STATE ? ALERT_DRAW_STATE : MAX_DRAW_STATE)
+#define H_ALERT_WIDTH 4.0
+
+#define HUD_REFRESH 0.5
+
+// Extra shared memory slots for instruments added through the control socket; adds beyond them are refused
+#define SHM_CONTROL_HEADROOM 64
 
 static GLchar * vShader = "#version 120\n"
 "attribute vec2 position;"
@@ -33,19 +55,51 @@ static GLchar * fShader = "#version 120\n"
 	"gl_FragColor = vec4(vColor);"
 "}\0";
 
-struct {
-	Display * dpy;
-	Window w;
-	GLXContext glx_context;
-	int width, height;
-	GLuint vHandle, fHandle, pHandle;
-	Colormap cmap;
-#ifdef SHOW_TEXT
-	XFontStruct * font;
-#endif
-} wa;
+/*
+ * Heatmap mode: one texel per instrument, laid out like the grid.
+ * r = direction (1.0 up, 0.5 down, 0 empty), g = percent change since the
+ * first price seen mapped around 0.5, with its low bit set when the last
+ * change fired an alert, b/a = frame of the last change.
+ */
+static GLchar * hvShader = "#version 120\n"
+"attribute vec2 position;"
+"void main()"
+"{"
+	"gl_Position = vec4(position.x, position.y, 0.0, 1.0);"
+"}\0";
 
-struct {
+static GLchar * hfShader = "#version 120\n"
+"uniform sampler2D prices;"
+"uniform vec2 grid;"
+"uniform vec2 screen;"
+"uniform float frame;"
+"uniform float fade;"
+"uniform float alert_fade;"
+"uniform float alert_width;"
+"void main()"
+"{"
+	"vec2 pos = vec2(gl_FragCoord.x / screen.x, 1.0 - gl_FragCoord.y / screen.y) * grid;"
+	"vec2 cell = floor(pos);"
+	"vec2 edge = fract(pos) * screen / grid;"
+	"vec4 t = texture2D(prices, (cell + 0.5) / grid);"
+	"if (t.r == 0.0 || edge.x < 1.0 || edge.y < 1.0) {"
+		"gl_FragColor = vec4(0.0, 0.0, 0.0, 1.0);"
+		"return;"
+	"}"
+	"float changed = floor(t.b * 255.0 + 0.5) + floor(t.a * 255.0 + 0.5) * 256.0;"
+	"float age = changed > 65534.5 ? 65535.0 : mod(frame - changed, 65535.0);"
+	"float state = max(1.0 - age / fade, 0.0);"
+	"float brightness = sqrt(1.0 - pow(state * 2.0 - 1.0, 2.0));"
+	"float level = 0.2 + 0.5 * abs(t.g * 2.0 - 1.0) + 0.3 * brightness;"
+	"vec4 color = t.r > 0.75 ? vec4(0.0, level, 0.0, 1.0) : vec4(level, 0.0, 0.0, 1.0);"
+	"vec2 size = screen / grid;"
+	"float border = min(min(edge.x, edge.y), min(size.x - edge.x, size.y - edge.y));"
+	"float alert = mod(floor(t.g * 255.0 + 0.5), 2.0);"
+	"if (alert > 0.5 && border < alert_width) color = mix(color, vec4(1.0), max(1.0 - age / alert_fade, 0.0));"
+	"gl_FragColor = color;"
+"}\0";
+
+typedef struct {
 	GLuint array_buffer;
 	GLint position;
 	GLint color;
@@ -54,15 +108,56 @@ struct {
 	short font_width;
 	short font_height;
 	#endif
-} gla;
+} GL_Attributes;
 
-State * state, * state_buffer;
+typedef struct {
+	GLuint vHandle, fHandle, pHandle;
+	GLuint texture;
+	GLuint quad_buffer;
+	GLint position, prices, grid, screen, frame, fade, alert_fade, alert_width;
+	Dimension d;
+	int first;
+	int num_instruments;
+	unsigned char * texels;
+	double * base_prices;
+	unsigned int frame_count;
+} Heatmap;
+
+typedef struct {
+	Display * dpy;
+	Window w;
+	GLXContext glx_context;
+	int x, y, width, height;
+	GLuint vHandle, fHandle, pHandle;
+	Colormap cmap;
+#ifdef SHOW_TEXT
+	XFontStruct * font;
+#endif
+	GL_Attributes gla;
+	Heatmap hm;
+	int heatmap;
+	double share_start, share_end;
+	int hud;
+	char hud_text[256];
+	double hud_updated;
+	Perf_Stats perf;
+	State * state;
+	pthread_t thread;
+	int failed;
+} Output;
+
+Output * outputs;
+int num_outputs;
+State * state_buffer, * snapshot;
+pthread_mutex_t mSnapshot = PTHREAD_MUTEX_INITIALIZER;
+int snapshot_readers;
+int done = 0;
 
 GLuint compileShader(GLchar * shader, GLenum type) {
 	GLuint ok;
 	GLuint shaderID = glCreateShader(type);
 	GLuint shaderLength = strlen(shader);
-	glShaderSource(shaderID, 1, &shader, &shaderLength);
+	glShaderSource(shaderID, 1, (const GLchar **)&shader, &shaderLength);
 	glCompileShader(shaderID);
 	glGetShaderiv(shaderID, GL_COMPILE_STATUS, &ok);
 	if (ok) {
@@ -100,36 +195,94 @@ GLuint createProgram(GLuint vShader, GLuint fShader) {
 	return 0;
 }
 
-typedef struct {
-	int x, y;
-} Dimension;
+//----------------------------DRAW---------------------------
+/*
+ * Each output shows the slice of instruments matching its share of the
+ * total screen area, so the board continues across monitors in order.
+ * Returns the number of instruments in the slice; the grid may have more
+ * cells than that, and the rest belong to the next output.
+ */
+int get_output_slice(Output * o, int num_instruments, int * first, Dimension * d) {
+	*first = o->share_start * num_instruments + 0.5;
+	int count = (int)(o->share_end * num_instruments + 0.5) - *first;
+	*d = get_grid_for_num_instruments(count, o->width, o->height);
+	return count;
+}
 
-Dimension get_grid_for_num_instruments(int num_instruments, int width, int height) {
-	Dimension d = {0};
-	if (!num_instruments) return d;
+#ifdef SHOW_TEXT
+// Overlays the latency statistics in the top left corner, refreshing the text every HUD_REFRESH seconds
+void draw_hud(Output * o) {
+	double now = get_monotonic_time();
+	if (now - o->hud_updated >= HUD_REFRESH) {
+		format_perf_stats(&o->perf, o->hud_text, sizeof(o->hud_text));
+		o->hud_updated = now;
+	}
 
-	float ratio = (float)width / height;
-	d.x = round(sqrt(num_instruments * ratio));
-	d.y = (num_instruments - 1) / d.x + 1;
-	int i;
-	for (i = (d.x > d.y ? d.y : d.x); i > sqrt(num_instruments * ratio / 2); --i) {
-		if (num_instruments % i == 0) {
-			if (width > height) {
-				d.x = num_instruments / i;
-				d.y = i;
-			} else {
-				d.x = i;
-				d.y = num_instruments / i;
+	GL_Attributes * gla = &o->gla;
+	glViewport(0, 0, o->width, o->height);
+	glUseProgram(0);
+	glListBase(gla->font_base);
+	glColor4f(1.0, 1.0, 1.0, 0.8);
+
+	char * line = o->hud_text;
+	int row;
+	for (row = 0; *line; ++row) {
+		char * end = strchr(line, '\n');
+		int length = end ? end - line : strlen(line);
+		glRasterPos2f(-1 + 2.0 * gla->font_width / o->width, 1 - 2.0 * gla->font_height * (row + 2) / o->height);
+		glCallLists(length, GL_UNSIGNED_BYTE, (unsigned char *)line);
+		line += end ? length + 1 : length;
+	}
+	glUseProgram(o->heatmap ? o->hm.pHandle : o->pHandle);
+}
+#endif
+
+// Swaps the frame in and samples how old the prices it shows are
+void present(Output * o, int first, int count) {
+#ifdef SHOW_TEXT
+	if (o->hud) draw_hud(o);
+#endif
+	glXSwapBuffers(o->dpy, o->w);
+	perf_record_present(&o->perf, o->state, first, count);
+}
+
+/*
+ * All outputs render from one snapshot of state_buffer. It only moves to a
+ * newer version once every output has copied the current one, so outputs
+ * are never more than a frame apart and state_buffer is locked once per
+ * version rather than once per output.
+ */
+void sync_snapshot(Output * o) {
+	pthread_mutex_lock(&mSnapshot);
+	if (snapshot_readers >= num_outputs) {
+		lock_state(state_buffer);
+		unsigned long version = state_buffer->version;
+		unlock_state(state_buffer);
+		if (version != snapshot->version) {
+			// Every output has taken the fade and alert of the last changes, so the next copy starts them afresh
+			lock_state(snapshot);
+			int i;
+			for (i = 0; i < snapshot->num_instruments; ++i) {
+				snapshot->instruments[i].draw_state = 0;
+				snapshot->instruments[i].alert_state = 0;
 			}
-			return d;
+			unlock_state(snapshot);
+			copy_state(snapshot, state_buffer, 0);
+			snapshot_readers = 0;
 		}
 	}
-	return d;
+	unsigned long seen = o->state->version;
+	copy_state(o->state, snapshot, 0);
+	if (o->state->version != seen) ++snapshot_readers;
+	pthread_mutex_unlock(&mSnapshot);
 }
 
-//----------------------------DRAW---------------------------
-void draw(Display * dpy, Window win, int s_width, int s_height) {
-	copy_state(state, state_buffer, 1);
+void draw(Output * o) {
+	sync_snapshot(o);
+
+	State * state = o->state;
+	GL_Attributes * gla = &o->gla;
+	int s_width = o->width, s_height = o->height;
 
 	lock_state(state);
 
@@ -137,16 +290,18 @@ void draw(Display * dpy, Window win, int s_width, int s_height) {
 	glClearColor(0.0, 0.0, 0.0, 0.0);
 	glClear(GL_COLOR_BUFFER_BIT);
 
-	Dimension d = get_grid_for_num_instruments(state->num_instruments, s_width, s_height);
-	int i;
-	for (i = 0; i < state->num_instruments; ++i) {
-		float left = s_width / d.x * (i % d.x);
-		float bottom = s_height / d.y * (d.y - 1 - i / d.x);
+	int first;
+	Dimension d;
+	int count = get_output_slice(o, state->num_instruments, &first, &d);
+	int j;
+	for (j = 0; j < count; ++j) {
+		float left = s_width / d.x * (j % d.x);
+		float bottom = s_height / d.y * (d.y - 1 - j / d.x);
 		float width = s_width / d.x;
 		float height = s_height / d.y;
 		glViewport(left, bottom, width, height);
 
-		Instrument_State * is = &state->instruments[i];
+		Instrument_State * is = &state->instruments[first + j];
 
 		GLfloat brightness = pow(1 - pow((float)is->draw_state / MAX_DRAW_STATE * 2 - 1, 2), 0.5);
 		if (is->draw_state) --is->draw_state;
@@ -162,34 +317,48 @@ void draw(Display * dpy, Window win, int s_width, int s_height) {
 			T_BOUND, T_BOUND, T_BOTTOM_BRIGHTNESS, 0.0, 0.0, brightness
 		};
 
-		glBindBuffer(GL_ARRAY_BUFFER, gla.array_buffer);
+		glBindBuffer(GL_ARRAY_BUFFER, gla->array_buffer);
 		if (is->direction == 'u') {
 			glBufferData(GL_ARRAY_BUFFER, sizeof(up), up, GL_STATIC_DRAW);
 		} else {
 			glBufferData(GL_ARRAY_BUFFER, sizeof(down), down, GL_STATIC_DRAW);
 		}
 
-		glEnableVertexAttribArray(gla.position);
-		glVertexAttribPointer(gla.position, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+		glEnableVertexAttribArray(gla->position);
+		glVertexAttribPointer(gla->position, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
 
-		glEnableVertexAttribArray(gla.color);
-		glVertexAttribPointer(gla.color, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
+		glEnableVertexAttribArray(gla->color);
+		glVertexAttribPointer(gla->color, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
 
 		glDrawArrays(GL_TRIANGLES, 0, 3);
 
+		if (is->alert_state) {
+			GLfloat alpha = (float)is->alert_state-- / ALERT_DRAW_STATE;
+			GLfloat outline[] = {
+				-A_BOUND, -A_BOUND, 1.0, 1.0, 1.0, alpha,
+				-A_BOUND, A_BOUND, 1.0, 1.0, 1.0, alpha,
+				A_BOUND, A_BOUND, 1.0, 1.0, 1.0, alpha,
+				A_BOUND, -A_BOUND, 1.0, 1.0, 1.0, alpha
+			};
+			glBufferData(GL_ARRAY_BUFFER, sizeof(outline), outline, GL_STATIC_DRAW);
+			glVertexAttribPointer(gla->position, 2, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), 0);
+			glVertexAttribPointer(gla->color, 4, GL_FLOAT, GL_FALSE, 6 * sizeof(GLfloat), (void *)(2 * sizeof(GLfloat)));
+			glDrawArrays(GL_LINE_LOOP, 0, 4);
+		}
+
 #ifdef SHOW_TEXT
-		glListBase(gla.font_base);
+		glListBase(gla->font_base);
 		glColor4f(1.0, 1.0, 1.0, brightness / 2 + 0.5);
 		float i_length = strlen(is->instrument);
-		GLfloat i_left = -i_length * gla.font_width / width;
-		GLfloat i_bottom = 0.9 - gla.font_height / height * 2;
+		GLfloat i_left = -i_length * gla->font_width / width;
+		GLfloat i_bottom = 0.9 - gla->font_height / height * 2;
 		glRasterPos2f(i_left, i_bottom);
 		glCallLists(i_length, GL_UNSIGNED_BYTE, (unsigned char *)is->instrument);
 
 		char price[16] = {0};
 		sprintf(price, "%f", is->price);
 		float p_length = strlen(price);
-		GLfloat p_left = -p_length * gla.font_width / width;
+		GLfloat p_left = -p_length * gla->font_width / width;
 		GLfloat p_bottom = -0.9;
 		glRasterPos2f(p_left, p_bottom);
 		glCallLists(p_length, GL_UNSIGNED_BYTE, (unsigned char *)price);
@@ -198,68 +367,282 @@ void draw(Display * dpy, Window win, int s_width, int s_height) {
 
 	unlock_state(state);
 
-	glXSwapBuffers(dpy, win);
+	present(o, first, count);
+}
+
+void resize_heatmap(Heatmap * hm, Dimension d, int first, int num_instruments) {
+	hm->d = d;
+	hm->first = first;
+	hm->num_instruments = num_instruments;
+	if (hm->texels) free(hm->texels);
+	if (hm->base_prices) free(hm->base_prices);
+	hm->texels = calloc(d.x * d.y * 4, 1);
+	hm->base_prices = calloc(num_instruments, sizeof(double));
+	if (!hm->texels || !hm->base_prices) {
+		hm->num_instruments = 0;
+		return;
+	}
+
+	int i;
+	for (i = 0; i < num_instruments; ++i) {
+		hm->texels[i * 4] = 127;
+		hm->texels[i * 4 + 2] = hm->texels[i * 4 + 3] = 0xff;
+	}
+	glBindTexture(GL_TEXTURE_2D, hm->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, d.x, d.y, 0, GL_RGBA, GL_UNSIGNED_BYTE, hm->texels);
+}
+
+// When only the instrument count changes, the texture and base prices of the remaining slots are kept
+void resize_heatmap_count(Heatmap * hm, int num_instruments) {
+	if (!hm->texels) return;
+	double * base_prices = realloc(hm->base_prices, (num_instruments ? num_instruments : 1) * sizeof(double));
+	if (!base_prices) return;
+	hm->base_prices = base_prices;
+
+	int i;
+	for (i = hm->num_instruments; i < num_instruments; ++i) {
+		base_prices[i] = 0;
+		memset(&hm->texels[i * 4], 0, 4);
+		hm->texels[i * 4] = 127;
+		hm->texels[i * 4 + 2] = hm->texels[i * 4 + 3] = 0xff;
+	}
+	for (i = num_instruments; i < hm->num_instruments; ++i) {
+		memset(&hm->texels[i * 4], 0, 4);
+	}
+	hm->num_instruments = num_instruments;
+	glBindTexture(GL_TEXTURE_2D, hm->texture);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, hm->d.x, hm->d.y, GL_RGBA, GL_UNSIGNED_BYTE, hm->texels);
+}
+
+/*
+ * Marks slots whose flash finished as expired, so their stamp does not look
+ * fresh again once frame_count wraps around to it. Sweeping every
+ * H_EXPIRE_SWEEP frames catches each stamp long before that.
+ */
+void expire_heatmap_stamps(Heatmap * hm) {
+	int i, expired = 0;
+	for (i = 0; i < hm->num_instruments; ++i) {
+		unsigned char * texel = &hm->texels[i * 4];
+		unsigned int stamp = texel[2] | texel[3] << 8;
+		if (stamp == H_EXPIRED) continue;
+		if ((hm->frame_count + H_FRAME_WRAP - stamp) % H_FRAME_WRAP > H_FLASH_FRAMES) {
+			texel[2] = texel[3] = 0xff;
+			expired = 1;
+		}
+	}
+	if (expired) {
+		glBindTexture(GL_TEXTURE_2D, hm->texture);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, hm->d.x, hm->d.y, GL_RGBA, GL_UNSIGNED_BYTE, hm->texels);
+	}
+}
+
+void draw_heatmap(Output * o) {
+	sync_snapshot(o);
+
+	State * state = o->state;
+	Heatmap * hm = &o->hm;
+	int s_width = o->width, s_height = o->height;
+
+	lock_state(state);
+
+	int first;
+	Dimension d;
+	int count = get_output_slice(o, state->num_instruments, &first, &d);
+	int resized = d.x != hm->d.x || d.y != hm->d.y || first != hm->first;
+	if (resized) {
+		resize_heatmap(hm, d, first, count);
+	} else if (count != hm->num_instruments) {
+		resize_heatmap_count(hm, count);
+	}
+
+	if (hm->texels && hm->frame_count % H_EXPIRE_SWEEP == 0) expire_heatmap_stamps(hm);
+
+	if (state->ready > 0 || resized) {
+		int first_row = d.y, last_row = -1;
+		int i;
+		for (i = 0; i < hm->num_instruments; ++i) {
+			Instrument_State * is = &state->instruments[first + i];
+			if (!is->changed && !resized) continue;
+
+			// The slot was refilled with another instrument after a subscription change
+			if (is->replaced) {
+				hm->base_prices[i] = 0;
+				is->replaced = 0;
+			}
+			if (!hm->base_prices[i]) hm->base_prices[i] = is->price;
+			double percent = hm->base_prices[i] ? (is->price / hm->base_prices[i] - 1) * 100 : 0;
+			float g = 0.5 + percent / H_PERCENT_RANGE / 2;
+
+			// The outline fades in the shader, so an alert only has to be noticed on the change that fired it
+			unsigned char * texel = &hm->texels[i * 4];
+			int alert = is->changed ? is->alert_state != 0 : texel[1] & 1;
+			is->alert_state = 0;
+			texel[0] = is->direction == 'u' ? 255 : 127;
+			texel[1] = g < 0 ? 0 : g > 1 ? 255 : g * 255;
+			texel[1] = (texel[1] & 0xfe) | alert;
+			if (is->changed) {
+				texel[2] = hm->frame_count & 0xff;
+				texel[3] = (hm->frame_count >> 8) & 0xff;
+			}
+
+			if (i / d.x < first_row) first_row = i / d.x;
+			last_row = i / d.x;
+		}
+		if (last_row >= first_row) {
+			glBindTexture(GL_TEXTURE_2D, hm->texture);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, first_row, d.x, last_row - first_row + 1,
+					GL_RGBA, GL_UNSIGNED_BYTE, hm->texels + first_row * d.x * 4);
+		}
+	}
+
+	unlock_state(state);
+
+	glViewport(0, 0, s_width, s_height);
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	if (hm->num_instruments) {
+		glUniform2f(hm->grid, d.x, d.y);
+		glUniform2f(hm->screen, s_width, s_height);
+		glUniform1f(hm->frame, hm->frame_count);
+
+		glBindBuffer(GL_ARRAY_BUFFER, hm->quad_buffer);
+		glEnableVertexAttribArray(hm->position);
+		glVertexAttribPointer(hm->position, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(GLfloat), 0);
+		glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	}
+	hm->frame_count = (hm->frame_count + 1) % H_FRAME_WRAP;
+
+	present(o, first, count);
 }
 
 //--------------------------INITIALIZATION------------------
-void initGL(Display * dpy, Window win, GLuint pHandle
+void initGL(GL_Attributes * gla, GLuint pHandle
 #ifdef SHOW_TEXT
 , XFontStruct * font
 #endif
 ) {
-	gla.position = glGetAttribLocation(pHandle, "position");
-	gla.color = glGetAttribLocation(pHandle, "color");
+	gla->position = glGetAttribLocation(pHandle, "position");
+	gla->color = glGetAttribLocation(pHandle, "color");
 
 #ifdef SHOW_TEXT
 	int first = font->min_char_or_byte2;
 	int last = font->max_char_or_byte2;
-	gla.font_base = glGenLists(last + 1);
-	glXUseXFont(font->fid, first, last - first + 1, gla.font_base + first);
+	gla->font_base = glGenLists(last + 1);
+	glXUseXFont(font->fid, first, last - first + 1, gla->font_base + first);
 
-	gla.font_width = font->max_bounds.width;
-	gla.font_height = font->max_bounds.ascent - font->max_bounds.descent;
+	gla->font_width = font->max_bounds.width;
+	gla->font_height = font->max_bounds.ascent - font->max_bounds.descent;
 #endif
 
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	glGenBuffers(1, &gla.array_buffer);
+	glGenBuffers(1, &gla->array_buffer);
 }
 
-int init_window() {
-	wa.w = 0;
-	wa.glx_context = NULL;
-	wa.vHandle = wa.fHandle = wa.pHandle = 0;
-	wa.cmap = 0;
+int compare_outputs(const void * a, const void * b) {
+	const Output * x = (const Output *)a;
+	const Output * y = (const Output *)b;
+	if (x->y != y->y) return x->y - y->y;
+	return x->x - y->x;
+}
+
+/*
+ * Finds one output per active CRTC (mirrored outputs share one), ordered
+ * top-to-bottom then left-to-right. Falls back to the whole default screen
+ * when XRandR is unavailable.
+ */
+int discover_outputs(Output ** outputs) {
+	*outputs = NULL;
+	Display * dpy = XOpenDisplay(NULL);
+	if (!dpy) return 0;
+
+	int screen = DefaultScreen(dpy);
+	int event_base, error_base;
+	int count = 0;
+	Output * list = NULL;
+	if (XRRQueryExtension(dpy, &event_base, &error_base)) {
+		XRRScreenResources * res = XRRGetScreenResources(dpy, RootWindow(dpy, screen));
+		if (res && (list = calloc(res->ncrtc, sizeof(Output)))) {
+			int i;
+			for (i = 0; i < res->ncrtc; ++i) {
+				XRRCrtcInfo * crtc = XRRGetCrtcInfo(dpy, res, res->crtcs[i]);
+				if (!crtc) continue;
+				if (crtc->mode != None && crtc->noutput > 0 && crtc->width && crtc->height) {
+					list[count].x = crtc->x;
+					list[count].y = crtc->y;
+					list[count].width = crtc->width;
+					list[count].height = crtc->height;
+					++count;
+				}
+				XRRFreeCrtcInfo(crtc);
+			}
+		}
+		if (res) XRRFreeScreenResources(res);
+	}
+	if (!count) {
+		if (list) free(list);
+		if (!(list = calloc(1, sizeof(Output)))) {
+			XCloseDisplay(dpy);
+			return 0;
+		}
+		list[0].width = DisplayWidth(dpy, screen);
+		list[0].height = DisplayHeight(dpy, screen);
+		count = 1;
+	}
+	XCloseDisplay(dpy);
+
+	qsort(list, count, sizeof(Output), compare_outputs);
+
+	double total_area = 0, area = 0;
+	int i;
+	for (i = 0; i < count; ++i) {
+		total_area += (double)list[i].width * list[i].height;
+	}
+	for (i = 0; i < count; ++i) {
+		list[i].share_start = area / total_area;
+		area += (double)list[i].width * list[i].height;
+		list[i].share_end = i == count - 1 ? 1.0 : area / total_area;
+	}
+
+	*outputs = list;
+	return count;
+}
+
+int init_window(Output * o) {
+	o->w = 0;
+	o->glx_context = NULL;
+	o->vHandle = o->fHandle = o->pHandle = 0;
+	o->cmap = 0;
 #ifdef SHOW_TEXT
-	wa.font = NULL;
+	o->font = NULL;
 #endif
 
-	wa.dpy = XOpenDisplay(NULL);
-	if (!wa.dpy) return 1;
+	o->dpy = XOpenDisplay(NULL);
+	if (!o->dpy) return 1;
 
 	int attrList[] = {GLX_RGBA, GLX_DOUBLEBUFFER, GLX_RED_SIZE, 4, GLX_GREEN_SIZE, 4, GLX_BLUE_SIZE, 4, None};
-	XVisualInfo * vinfo = glXChooseVisual(wa.dpy, DefaultScreen(wa.dpy), attrList);
+	XVisualInfo * vinfo = glXChooseVisual(o->dpy, DefaultScreen(o->dpy), attrList);
 	if (!vinfo) {
 		printf("Unable to acquire visual\n");
-		wa.dpy = NULL;
 		return 1;
 	}
 
 	XSetWindowAttributes swa;
 	swa.event_mask = ButtonPressMask | KeyPressMask | PointerMotionMask | StructureNotifyMask;
-	swa.colormap = XCreateColormap(wa.dpy, RootWindow(wa.dpy, vinfo->screen), vinfo->visual, AllocNone);
-	wa.cmap = swa.colormap;
+	swa.colormap = XCreateColormap(o->dpy, RootWindow(o->dpy, vinfo->screen), vinfo->visual, AllocNone);
+	o->cmap = swa.colormap;
 
 #ifdef FULLSCREEN
 	swa.override_redirect = 1;
 #endif
 
-	wa.w = XCreateWindow(wa.dpy,
-			DefaultRootWindow(wa.dpy),
-			0,
-			0,
-			DisplayWidth(wa.dpy, vinfo->screen),
-			DisplayHeight(wa.dpy, vinfo->screen),
+	o->w = XCreateWindow(o->dpy,
+			DefaultRootWindow(o->dpy),
+			o->x,
+			o->y,
+			o->width,
+			o->height,
 			0,
 			0,
 			CopyFromParent,
@@ -270,126 +653,304 @@ int init_window() {
 			CWColormap | CWEventMask,
 #endif
 			&swa);
-	if (!wa.w) {
+	if (!o->w) {
 		printf("Unable to create window\n");
+		XFree(vinfo);
 		return 1;
 	}
 
-	wa.width = DisplayWidth(wa.dpy, vinfo->screen);
-	wa.height = DisplayHeight(wa.dpy, vinfo->screen);
-
-	wa.glx_context = glXCreateContext(wa.dpy, vinfo, NULL, True);
+	o->glx_context = glXCreateContext(o->dpy, vinfo, NULL, True);
 	XFree(vinfo);
-	if (!wa.glx_context) {
+	if (!o->glx_context) {
 		printf("Unable to create context\n");
 		return 1;
 	}
-	if (!glXMakeCurrent(wa.dpy, wa.w, wa.glx_context)) {
+	if (!glXMakeCurrent(o->dpy, o->w, o->glx_context)) {
 		printf("glXMakeCurrent failed\n");
 		return 1;
 	}
 
-	wa.vHandle = compileShader(vShader, GL_VERTEX_SHADER);
-	wa.fHandle = compileShader(fShader, GL_FRAGMENT_SHADER);
-	wa.pHandle = createProgram(wa.vHandle, wa.fHandle);
-	if (!wa.vHandle || !wa.fHandle || !wa.pHandle) {
+	o->vHandle = compileShader(vShader, GL_VERTEX_SHADER);
+	o->fHandle = compileShader(fShader, GL_FRAGMENT_SHADER);
+	o->pHandle = createProgram(o->vHandle, o->fHandle);
+	if (!o->vHandle || !o->fHandle || !o->pHandle) {
 		printf("Compile failed\n");
 		return 1;
 	}
-	glUseProgram(wa.pHandle);
+	glUseProgram(o->pHandle);
 
 #ifdef SHOW_TEXT
-	wa.font = XLoadQueryFont(wa.dpy, FONT_USED);
-	if (!wa.font) {
+	o->font = XLoadQueryFont(o->dpy, FONT_USED);
+	if (!o->font) {
 		printf("Font not found\n");
 		return 1;
 	}
 #endif
 
-	initGL(wa.dpy, wa.w, wa.pHandle
+	initGL(&o->gla, o->pHandle
 #ifdef SHOW_TEXT
-	, wa.font
+	, o->font
 #endif
 	);
 
-	XMapRaised(wa.dpy, wa.w);
+	XMapRaised(o->dpy, o->w);
 
 #ifdef FULLSCREEN
-	XGrabKeyboard(wa.dpy, wa.w, True, GrabModeAsync, GrabModeAsync, CurrentTime);
-	XGrabPointer(wa.dpy, wa.w, True, PointerMotionMask, GrabModeAsync, GrabModeAsync, wa.w, None, CurrentTime);
+	// Only the first output grabs input; any output still receives pointer motion
+	if (o == &outputs[0]) {
+		XGrabKeyboard(o->dpy, o->w, True, GrabModeAsync, GrabModeAsync, CurrentTime);
+		XGrabPointer(o->dpy, o->w, True, PointerMotionMask, GrabModeAsync, GrabModeAsync, None, None, CurrentTime);
+	}
 #endif
 
 	return 0;
 }
 
-void tear_down_window() {
-	glDeleteShader(wa.vHandle);
-	glDeleteShader(wa.fHandle);
-	glDeleteProgram(wa.pHandle);
+int init_heatmap(Heatmap * hm) {
+	hm->texture = hm->quad_buffer = 0;
+	hm->d.x = hm->d.y = 0;
+	hm->first = 0;
+	hm->num_instruments = 0;
+	hm->texels = NULL;
+	hm->base_prices = NULL;
+	hm->frame_count = 0;
+
+	hm->vHandle = compileShader(hvShader, GL_VERTEX_SHADER);
+	hm->fHandle = compileShader(hfShader, GL_FRAGMENT_SHADER);
+	hm->pHandle = createProgram(hm->vHandle, hm->fHandle);
+	if (!hm->vHandle || !hm->fHandle || !hm->pHandle) {
+		printf("Heatmap compile failed\n");
+		return 1;
+	}
+	glUseProgram(hm->pHandle);
+
+	hm->position = glGetAttribLocation(hm->pHandle, "position");
+	hm->prices = glGetUniformLocation(hm->pHandle, "prices");
+	hm->grid = glGetUniformLocation(hm->pHandle, "grid");
+	hm->screen = glGetUniformLocation(hm->pHandle, "screen");
+	hm->frame = glGetUniformLocation(hm->pHandle, "frame");
+	hm->fade = glGetUniformLocation(hm->pHandle, "fade");
+	hm->alert_fade = glGetUniformLocation(hm->pHandle, "alert_fade");
+	hm->alert_width = glGetUniformLocation(hm->pHandle, "alert_width");
+	glUniform1i(hm->prices, 0);
+	glUniform1f(hm->fade, MAX_DRAW_STATE);
+	glUniform1f(hm->alert_fade, ALERT_DRAW_STATE);
+	glUniform1f(hm->alert_width, H_ALERT_WIDTH);
+
+	glActiveTexture(GL_TEXTURE0);
+	glGenTextures(1, &hm->texture);
+	glBindTexture(GL_TEXTURE_2D, hm->texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	GLfloat quad[] = {-1.0, -1.0, 1.0, -1.0, -1.0, 1.0, 1.0, 1.0};
+	glGenBuffers(1, &hm->quad_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, hm->quad_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+	return 0;
+}
+
+void tear_down_heatmap(Heatmap * hm) {
+	if (hm->texture) glDeleteTextures(1, &hm->texture);
+	if (hm->quad_buffer) glDeleteBuffers(1, &hm->quad_buffer);
+	glDeleteShader(hm->vHandle);
+	glDeleteShader(hm->fHandle);
+	glDeleteProgram(hm->pHandle);
+	if (hm->texels) free(hm->texels);
+	if (hm->base_prices) free(hm->base_prices);
+}
+
+void tear_down_window(Output * o) {
+	if (o->glx_context) {
+		glDeleteShader(o->vHandle);
+		glDeleteShader(o->fHandle);
+		glDeleteProgram(o->pHandle);
+	}
 
 #ifdef SHOW_TEXT
-	if (wa.font) XFreeFont(wa.dpy, wa.font);
+	if (o->font) XFreeFont(o->dpy, o->font);
 #endif
-	if (wa.cmap) XFreeColormap(wa.dpy, wa.cmap);
-	if (wa.glx_context) {
-		glXMakeCurrent(wa.dpy, None, NULL);
-		glXDestroyContext(wa.dpy, wa.glx_context);
+	if (o->cmap) XFreeColormap(o->dpy, o->cmap);
+	if (o->glx_context) {
+		glXMakeCurrent(o->dpy, None, NULL);
+		glXDestroyContext(o->dpy, o->glx_context);
 	}
-	if (wa.w) XDestroyWindow(wa.dpy, wa.w);
-	if (wa.dpy) XCloseDisplay(wa.dpy);
+	if (o->w) XDestroyWindow(o->dpy, o->w);
+	if (o->dpy) XCloseDisplay(o->dpy);
 }
 
-//-------------------------------MAIN-----------------------------
-int main(int argc, char ** argv) {
-	if (!(--argc)) {
-		printf("You must specify at least one instrument to subscribe to (example format: EUR_USD)\n");
-		return 1;
-	}
-	++argv;
+//-------------------------------RENDER---------------------------
+int is_done() {
+	return __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+}
 
-	curl_global_init(CURL_GLOBAL_ALL);
+void set_done() {
+	__atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+}
 
-	if (init_window()) {
-		tear_down_window();
-		curl_global_cleanup();
-		return 1;
+/*
+ * Every output owns its display connection, window, context and render copy
+ * of the state, so outputs only share the snapshot and render in parallel.
+ */
+void * render_t(void * arg) {
+	Output * o = (Output *)arg;
+	if (init_window(o) || (o->heatmap && init_heatmap(&o->hm))) {
+		o->failed = 1;
+		set_done();
 	}
 
-	state = new_state();
-	state_buffer = new_state();
-	pthread_t poll_thread = setup_state_and_poll_thread(state_buffer, argc, argv);
-
 	XEvent event;
-	int done = 0;
-
-	while (!done && poll_thread) {
-		if (XPending(wa.dpy)) {
-			XNextEvent(wa.dpy, &event);
+	while (!is_done()) {
+		while (XPending(o->dpy)) {
+			XNextEvent(o->dpy, &event);
 			switch(event.type) {
 			case ConfigureNotify: {
 				XWindowAttributes xwa;
-				XGetWindowAttributes(wa.dpy, wa.w, &xwa);
-				wa.width = xwa.width;
-				wa.height = xwa.height;
+				XGetWindowAttributes(o->dpy, o->w, &xwa);
+				o->width = xwa.width;
+				o->height = xwa.height;
 				break;
 			}
 			case ButtonPress:
 			case KeyPress:
 			case MotionNotify:
 			{
-				done = 1;
+				set_done();
 				break;
 			}
 			}
 		}
-		if (!done) {
-			draw(wa.dpy, wa.w, wa.width, wa.height);
+		if (!is_done()) {
+			if (o->heatmap) {
+				draw_heatmap(o);
+			} else {
+				draw(o);
+			}
+		}
+	}
+
+	if (o->heatmap && o->glx_context) tear_down_heatmap(&o->hm);
+	tear_down_window(o);
+	return NULL;
+}
+
+//-------------------------------MAIN-----------------------------
+int main(int argc, char ** argv) {
+	char * publish_name = NULL;
+	char * attach_name = NULL;
+	char * alerts_path = NULL;
+	char * intervals = NULL;
+	char * control_path = NULL;
+	int heatmap = 0;
+	int hud = 0;
+	double log_interval = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "s:r:a:Hp:c:PL:")) != -1) {
+		switch (opt) {
+		case 's':
+			publish_name = optarg;
+			break;
+		case 'r':
+			attach_name = optarg;
+			break;
+		case 'a':
+			alerts_path = optarg;
+			break;
+		case 'p':
+			intervals = optarg;
+			break;
+		case 'c':
+			control_path = optarg;
+			break;
+		case 'H':
+			heatmap = 1;
+			break;
+		case 'P':
+			hud = 1;
+			break;
+		case 'L':
+			log_interval = atof(optarg);
+			break;
+		default:
+			printf("Usage: %s [-H] [-P] [-L log_seconds] [-a alert_rules] [-p min_ms,max_ms] [-c control_socket] [-s shm_name | -r shm_name] [instrument name]...\n", argv[0]);
+			return 1;
 		}
 	}
+	argc -= optind;
+	argv += optind;
 
+	if (!argc && !attach_name) {
+		printf("You must specify at least one instrument to subscribe to (example format: EUR_USD)\n");
+		return 1;
+	}
+
+	XInitThreads();
+	num_outputs = discover_outputs(&outputs);
+	if (!num_outputs) {
+		printf("Unable to open display\n");
+		return 1;
+	}
+
+	Alert_Rules * alerts = NULL;
+	if (alerts_path && !(alerts = load_alert_rules(alerts_path))) return 1;
+
+	Shm_State * shm = NULL;
+	if (attach_name) {
+		if (!(shm = attach_shm_state(attach_name))) return 1;
+	} else if (publish_name) {
+		if (!(shm = create_shm_state(publish_name, control_path ? argc + SHM_CONTROL_HEADROOM : argc))) return 1;
+	}
+
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	state_buffer = new_state();
+	snapshot = new_state();
+	snapshot_readers = num_outputs;
+	pthread_t poll_thread;
+	if (attach_name) {
+		poll_thread = setup_state_and_shm_thread(state_buffer, shm);
+	} else {
+		state_buffer->shm = shm;
+		state_buffer->alerts = alerts;
+		state_buffer->control_path = control_path;
+		poll_thread = 0;
+		if (!intervals || !set_poll_intervals(state_buffer, intervals)) {
+			poll_thread = setup_state_and_poll_thread(state_buffer, argc, argv);
+		}
+	}
+
+	int i, failed = !poll_thread;
+	for (i = 0; i < num_outputs && poll_thread; ++i) {
+		Output * o = &outputs[i];
+		o->heatmap = heatmap;
+		o->hud = hud;
+		o->hud_updated = 0;
+		char label[32];
+		snprintf(label, sizeof(label), "output %d", i);
+		init_perf_stats(&o->perf, label, log_interval);
+		o->state = new_state();
+		if (pthread_create(&o->thread, NULL, render_t, o)) {
+			o->thread = 0;
+			failed = 1;
+			set_done();
+		}
+	}
+	for (i = 0; i < num_outputs; ++i) {
+		Output * o = &outputs[i];
+		if (o->thread) pthread_join(o->thread, NULL);
+		if (o->failed) failed = 1;
+		if (o->state) delete_state(o->state);
+	}
+
+	delete_state(snapshot);
 	destroy_state_and_poll_thread(state_buffer, poll_thread);
-	tear_down_window();
+	delete_shm_state(shm);
+	delete_alert_rules(alerts);
+	free(outputs);
 	curl_global_cleanup();
 
-	return 0;
+	return failed;
 }
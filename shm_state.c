@@ -0,0 +1,352 @@
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "shm_state.h"
+
+#define SHM_READ_INTERVAL 50000000
+#define SNAPSHOT_RETRIES 100
+#define SNAPSHOT_BACKOFF 1000000
+#define SHM_HEARTBEAT_INTERVAL 250000000
+#define SHM_STALE_TIMEOUT 2000
+
+static Shm_State * new_shm_state(const char * name) {
+	Shm_State * shm = (Shm_State *) malloc(sizeof(Shm_State));
+	if (!shm) return NULL;
+
+	snprintf(shm->name, sizeof(shm->name), "%s%s", name[0] == '/' ? "" : "/", name);
+	shm->fd = -1;
+	shm->owner = 0;
+	shm->size = 0;
+	shm->layout = NULL;
+	shm->snapshot = NULL;
+	shm->last_tick = 0;
+	shm->published_version = 0;
+	shm->inode = 0;
+	shm->heartbeat_thread = 0;
+	shm->stopping = 0;
+	shm->stale = 0;
+	return shm;
+}
+
+static unsigned long heartbeat_now() {
+	return get_monotonic_time() * 1000;
+}
+
+// Readers only go by the heartbeat; pids are only comparable within one pid namespace
+static int is_stale(Shm_Layout * layout, int check_owner) {
+	pid_t owner = __atomic_load_n(&layout->owner_pid, __ATOMIC_RELAXED);
+	long age = heartbeat_now() - __atomic_load_n(&layout->heartbeat, __ATOMIC_ACQUIRE);
+	if (check_owner && owner > 0 && kill(owner, 0) && errno == ESRCH) return 1;
+	return age > SHM_STALE_TIMEOUT;
+}
+
+static ino_t segment_inode(int fd) {
+	struct stat st;
+	return fd >= 0 && !fstat(fd, &st) ? st.st_ino : 0;
+}
+
+// Maps an existing segment read-only, checking that it has our layout
+static int map_segment(Shm_State * shm, int quiet) {
+	struct stat st;
+	shm->fd = shm_open(shm->name, O_RDONLY, 0);
+	if (shm->fd < 0 || fstat(shm->fd, &st) || st.st_size < sizeof(Shm_Layout)) {
+		if (!quiet) fprintf(stderr, "Unable to open shared memory segment %s\n", shm->name);
+		return 0;
+	}
+	shm->size = st.st_size;
+	shm->inode = st.st_ino;
+
+	void * addr = mmap(NULL, shm->size, PROT_READ, MAP_SHARED, shm->fd, 0);
+	if (addr == MAP_FAILED) {
+		if (!quiet) fprintf(stderr, "Unable to map shared memory segment %s\n", shm->name);
+		return 0;
+	}
+	shm->layout = (Shm_Layout *) addr;
+
+	if (__atomic_load_n(&shm->layout->magic, __ATOMIC_ACQUIRE) != SHM_STATE_MAGIC
+			|| shm->layout->version != SHM_STATE_VERSION
+			|| shm->size < sizeof(Shm_Layout) + shm->layout->capacity * sizeof(Shm_Instrument)) {
+		if (!quiet) fprintf(stderr, "Shared memory segment %s has an unknown layout\n", shm->name);
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Unlinks the segment under name if the publisher that created it is gone.
+ * Its readers keep their mapping until they move to the new segment, so
+ * nothing is truncated under them.
+ */
+static int remove_stale_segment(const char * name) {
+	Shm_State * old = new_shm_state(name);
+	if (!old) return 0;
+	int stale = map_segment(old, 1) && is_stale(old->layout, 1);
+	if (stale) {
+		fprintf(stderr, "Replacing stale shared memory segment %s left by process %d\n", name, (int)old->layout->owner_pid);
+		shm_unlink(name);
+	}
+	delete_shm_state(old);
+	return stale;
+}
+
+static void * heartbeat_t(void * arg) {
+	Shm_State * shm = (Shm_State *)arg;
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = SHM_HEARTBEAT_INTERVAL;
+	while (!__atomic_load_n(&shm->stopping, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&shm->layout->heartbeat, heartbeat_now(), __ATOMIC_RELEASE);
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+Shm_State * create_shm_state(const char * name, int capacity) {
+	Shm_State * shm = new_shm_state(name);
+	if (!shm) return NULL;
+
+	// Never take over a live segment: truncating it would fault its readers
+	shm->size = sizeof(Shm_Layout) + capacity * sizeof(Shm_Instrument);
+	shm->fd = shm_open(shm->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (shm->fd < 0 && errno == EEXIST && remove_stale_segment(shm->name)) {
+		shm->fd = shm_open(shm->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+	}
+	if (shm->fd < 0) {
+		fprintf(stderr, "Shared memory segment %s is in use or cannot be created\n", shm->name);
+		delete_shm_state(shm);
+		return NULL;
+	}
+	shm->owner = 1;
+	shm->inode = segment_inode(shm->fd);
+	if (ftruncate(shm->fd, shm->size)) {
+		fprintf(stderr, "Unable to create shared memory segment %s\n", shm->name);
+		delete_shm_state(shm);
+		return NULL;
+	}
+
+	void * addr = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->fd, 0);
+	if (addr == MAP_FAILED) {
+		fprintf(stderr, "Unable to map shared memory segment %s\n", shm->name);
+		delete_shm_state(shm);
+		return NULL;
+	}
+	shm->layout = (Shm_Layout *) addr;
+
+	memset(shm->layout, 0, shm->size);
+	shm->layout->version = SHM_STATE_VERSION;
+	shm->layout->capacity = capacity;
+	shm->layout->owner_pid = getpid();
+	shm->layout->heartbeat = heartbeat_now();
+	__atomic_store_n(&shm->layout->magic, SHM_STATE_MAGIC, __ATOMIC_RELEASE);
+
+	if (pthread_create(&shm->heartbeat_thread, NULL, heartbeat_t, shm)) {
+		fprintf(stderr, "Unable to start the heartbeat for shared memory segment %s\n", shm->name);
+		shm->heartbeat_thread = 0;
+		delete_shm_state(shm);
+		return NULL;
+	}
+	return shm;
+}
+
+Shm_State * attach_shm_state(const char * name) {
+	Shm_State * shm = new_shm_state(name);
+	if (!shm) return NULL;
+
+	if (!map_segment(shm, 0) || !(shm->snapshot = (Shm_Layout *) malloc(shm->size))) {
+		delete_shm_state(shm);
+		return NULL;
+	}
+	return shm;
+}
+
+// Only unlinks the name if it still refers to our segment, not one that replaced it
+static int still_ours(Shm_State * shm) {
+	int fd = shm_open(shm->name, O_RDONLY, 0);
+	int ours = fd >= 0 && segment_inode(fd) == shm->inode;
+	if (fd >= 0) close(fd);
+	return ours;
+}
+
+void delete_shm_state(Shm_State * shm) {
+	if (shm) {
+		if (shm->heartbeat_thread) {
+			__atomic_store_n(&shm->stopping, 1, __ATOMIC_RELEASE);
+			pthread_join(shm->heartbeat_thread, NULL);
+		}
+		if (shm->owner && still_ours(shm)) shm_unlink(shm->name);
+		if (shm->layout) munmap(shm->layout, shm->size);
+		if (shm->snapshot) free(shm->snapshot);
+		if (shm->fd >= 0) close(shm->fd);
+		free(shm);
+	}
+}
+
+//-------------------------PUBLISHER-----------------------
+void publish_state(Shm_State * shm, State * state) {
+	if (!shm || !shm->owner || !state) return;
+	Shm_Layout * layout = shm->layout;
+
+	lock_state(state);
+	int n = state->num_instruments < layout->capacity ? state->num_instruments : layout->capacity;
+
+	__atomic_store_n(&layout->seq, layout->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	++layout->tick;
+	layout->num_instruments = n;
+	int i;
+	for (i = 0; i < n; ++i) {
+		Instrument_State * source_i = &state->instruments[i];
+		Shm_Instrument * target_i = &layout->instruments[i];
+		strcpy(target_i->instrument, source_i->instrument);
+		target_i->price = source_i->price;
+		target_i->direction = source_i->direction;
+		target_i->server_time = source_i->server_time;
+		target_i->receive_time = source_i->receive_time;
+		target_i->alert_state = source_i->alert_state;
+		if (source_i->version > shm->published_version) target_i->tick = layout->tick;
+	}
+	shm->published_version = state->version;
+
+	__atomic_store_n(&layout->seq, layout->seq + 1, __ATOMIC_RELEASE);
+	unlock_state(state);
+}
+
+//-------------------------READER--------------------------
+/*
+ * Gives up after SNAPSHOT_RETRIES attempts, so a publisher that died
+ * mid-write (leaving seq odd) cannot hang the reader or its shutdown.
+ */
+static int take_snapshot(Shm_State * shm, State * state) {
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = SNAPSHOT_BACKOFF;
+	int attempt;
+	for (attempt = 0; attempt < SNAPSHOT_RETRIES && is_ready(state) >= 0; ++attempt) {
+		unsigned int seq = __atomic_load_n(&shm->layout->seq, __ATOMIC_ACQUIRE);
+		if (!(seq & 1)) {
+			memcpy(shm->snapshot, shm->layout, shm->size);
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+			if (seq == __atomic_load_n(&shm->layout->seq, __ATOMIC_RELAXED)) return 1;
+		}
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
+
+int read_shm_state(Shm_State * shm, State * state) {
+	if (!shm || !shm->snapshot || !state) return 0;
+
+	if (!take_snapshot(shm, state)) return 0;
+	Shm_Layout * snapshot = shm->snapshot;
+	if (snapshot->tick == shm->last_tick) return 0;
+
+	int n = snapshot->num_instruments;
+	if (n < 0 || sizeof(Shm_Layout) + n * sizeof(Shm_Instrument) > shm->size) return 0;
+
+	lock_state(state);
+	if (state->num_instruments != n && resize_instruments(state, n)) {
+		unlock_state(state);
+		return 0;
+	}
+
+	int i;
+	for (i = 0; i < state->num_instruments; ++i) {
+		Shm_Instrument * source_i = &snapshot->instruments[i];
+		Instrument_State * target_i = &state->instruments[i];
+		target_i->price = source_i->price;
+		target_i->direction = source_i->direction;
+		target_i->server_time = source_i->server_time;
+		target_i->receive_time = source_i->receive_time;
+		// A slot whose name changed was refilled after a subscription change
+		if ((target_i->changed = source_i->tick > shm->last_tick || strcmp(target_i->instrument, source_i->instrument))) {
+			strcpy(target_i->instrument, source_i->instrument);
+			target_i->draw_state = MAX_DRAW_STATE;
+			target_i->alert_state = source_i->alert_state;
+			target_i->version = state->version + 1;
+		}
+	}
+	shm->last_tick = snapshot->tick;
+	unlock_state(state);
+
+	mark_ready(state);
+	return 1;
+}
+
+// Moves the reader onto a live segment that replaced the one it has mapped
+static int reattach_shm_state(Shm_State * shm) {
+	Shm_State * fresh = new_shm_state(shm->name);
+	if (!fresh) return 0;
+	if (!map_segment(fresh, 1) || fresh->inode == shm->inode || is_stale(fresh->layout, 0)
+			|| !(fresh->snapshot = (Shm_Layout *) malloc(fresh->size))) {
+		delete_shm_state(fresh);
+		return 0;
+	}
+
+	munmap(shm->layout, shm->size);
+	free(shm->snapshot);
+	close(shm->fd);
+	shm->fd = fresh->fd;
+	shm->inode = fresh->inode;
+	shm->size = fresh->size;
+	shm->layout = fresh->layout;
+	shm->snapshot = fresh->snapshot;
+	shm->last_tick = 0;
+	fresh->fd = -1;
+	fresh->layout = NULL;
+	fresh->snapshot = NULL;
+	delete_shm_state(fresh);
+	return 1;
+}
+
+/*
+ * Once the publisher's heartbeat stops, the reader moves to a replacement
+ * segment as soon as a new publisher creates one, and reports the prices as
+ * stale until then.
+ */
+static void check_publisher(Shm_State * shm) {
+	if (!is_stale(shm->layout, 0)) {
+		if (shm->stale) fprintf(stderr, "Publisher of shared memory segment %s is back\n", shm->name);
+		shm->stale = 0;
+	} else if (reattach_shm_state(shm)) {
+		fprintf(stderr, "Attached to the new shared memory segment %s\n", shm->name);
+		shm->stale = 0;
+	} else if (!shm->stale) {
+		fprintf(stderr, "Publisher of shared memory segment %s stopped, prices are stale\n", shm->name);
+		shm->stale = 1;
+	}
+}
+
+static void * shm_t(void * arg) {
+	State * state = (State *)arg;
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = SHM_READ_INTERVAL;
+	while (is_ready(state) >= 0) {
+		check_publisher(state->shm);
+		read_shm_state(state->shm, state);
+		nanosleep(&ts, NULL);
+	}
+	return NULL;
+}
+
+pthread_t setup_state_and_shm_thread(State * state, Shm_State * shm) {
+	if (!state || !shm) return 0;
+
+	lock_state(state);
+	state->shm = shm;
+	unlock_state(state);
+
+	pthread_t thread = 0;
+	if (pthread_create(&thread, NULL, shm_t, state)) {
+		thread = 0;
+	}
+	return thread;
+}
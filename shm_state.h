@@ -0,0 +1,67 @@
+#ifndef SHM_STATE
+#define SHM_STATE
+
+#include <sys/types.h>
+#include <pthread.h>
+#include <stddef.h>
+#include "poll_t.h"
+
+#define SHM_STATE_MAGIC 0x4f414e44
+#define SHM_STATE_VERSION 4
+
+/*
+ * Layout of the shared segment. The publisher bumps seq to an odd value
+ * before touching anything past the header and back to an even value once
+ * it is done; readers retry their copy until they see the same even seq on
+ * both sides of it.
+ *
+ * The publisher also stores its pid and refreshes heartbeat (monotonic
+ * milliseconds) from a thread of its own. A segment whose owner has died or
+ * whose heartbeat has stopped is stale: a new publisher replaces it, and
+ * readers move to the replacement or report the prices as stale.
+ */
+typedef struct {
+	char instrument[16];
+	double price;
+	char direction;
+	int alert_state;
+	unsigned long tick;
+	double server_time;
+	double receive_time;
+} Shm_Instrument;
+
+typedef struct {
+	unsigned int magic;
+	unsigned int version;
+	unsigned int seq;
+	int num_instruments;
+	int capacity;
+	unsigned long tick;
+	pid_t owner_pid;
+	unsigned long heartbeat;
+	Shm_Instrument instruments[];
+} Shm_Layout;
+
+typedef struct Shm_State {
+	char name[64];
+	int fd;
+	int owner;
+	ino_t inode;
+	size_t size;
+	Shm_Layout * layout;
+	Shm_Layout * snapshot;
+	unsigned long last_tick;
+	unsigned long published_version;
+	pthread_t heartbeat_thread;
+	int stopping;
+	int stale;
+} Shm_State;
+
+Shm_State * create_shm_state(const char * name, int capacity);
+Shm_State * attach_shm_state(const char * name);
+void delete_shm_state(Shm_State * shm);
+void publish_state(Shm_State * shm, State * state);
+int read_shm_state(Shm_State * shm, State * state);
+pthread_t setup_state_and_shm_thread(State * state, Shm_State * shm);
+
+#endif
@@ -0,0 +1,62 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include "spsc_queue.h"
+
+int init_spsc_queue(Spsc_Queue * queue, unsigned int capacity) {
+	queue->slots = (struct String **)calloc(capacity, sizeof(struct String *));
+	if (!queue->slots) return 1;
+	queue->capacity = capacity;
+	queue->head = queue->tail = 0;
+	sem_init(&queue->items, 0, 0);
+	sem_init(&queue->spaces, 0, capacity);
+	return 0;
+}
+
+void destroy_spsc_queue(Spsc_Queue * queue) {
+	if (queue->slots) free(queue->slots);
+	queue->slots = NULL;
+	sem_destroy(&queue->items);
+	sem_destroy(&queue->spaces);
+}
+
+// Waits up to timeout_ms (forever if negative); returns 0 on success
+static int wait_semaphore(sem_t * sem, int timeout_ms) {
+	if (timeout_ms < 0) {
+		while (sem_wait(sem)) {
+			if (errno != EINTR) return 1;
+		}
+		return 0;
+	}
+
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += timeout_ms / 1000;
+	ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+	if (ts.tv_nsec >= 1000000000L) {
+		++ts.tv_sec;
+		ts.tv_nsec -= 1000000000L;
+	}
+	while (sem_timedwait(sem, &ts)) {
+		if (errno != EINTR) return 1;
+	}
+	return 0;
+}
+
+int spsc_push(Spsc_Queue * queue, struct String * item, int timeout_ms) {
+	if (wait_semaphore(&queue->spaces, timeout_ms)) return 1;
+	unsigned int tail = __atomic_load_n(&queue->tail, __ATOMIC_RELAXED);
+	queue->slots[tail] = item;
+	__atomic_store_n(&queue->tail, (tail + 1) % queue->capacity, __ATOMIC_RELEASE);
+	sem_post(&queue->items);
+	return 0;
+}
+
+struct String * spsc_pop(Spsc_Queue * queue, int timeout_ms) {
+	if (wait_semaphore(&queue->items, timeout_ms)) return NULL;
+	unsigned int head = __atomic_load_n(&queue->head, __ATOMIC_RELAXED);
+	struct String * item = queue->slots[head];
+	__atomic_store_n(&queue->head, (head + 1) % queue->capacity, __ATOMIC_RELEASE);
+	sem_post(&queue->spaces);
+	return item;
+}
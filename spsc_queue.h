@@ -0,0 +1,24 @@
+#ifndef SPSC_QUEUE
+#define SPSC_QUEUE
+
+#include <semaphore.h>
+#include "s_string.h"
+
+/*
+ * Bounded single-producer/single-consumer ring of response buffers.
+ * head and tail are each written by one side only; the semaphores let
+ * either side block, with a timeout, on an empty or full ring.
+ */
+typedef struct {
+	struct String ** slots;
+	unsigned int capacity;
+	unsigned int head, tail;
+	sem_t items, spaces;
+} Spsc_Queue;
+
+int init_spsc_queue(Spsc_Queue * queue, unsigned int capacity);
+void destroy_spsc_queue(Spsc_Queue * queue);
+int spsc_push(Spsc_Queue * queue, struct String * item, int timeout_ms);
+struct String * spsc_pop(Spsc_Queue * queue, int timeout_ms);
+
+#endif
@@ -0,0 +1,151 @@
+#include <curl/curl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "poll_t.h"
+#include "perf_stats.h"
+#include "shm_state.h"
+#include "alerts.h"
+#include "term_draw.h"
+
+#define FRAME_RATE 33333333
+
+State * state, * state_buffer;
+Perf_Stats perf;
+volatile sig_atomic_t done = 0, resized = 1;
+
+void on_signal(int sig) {
+	if (sig == SIGWINCH) {
+		resized = 1;
+	} else {
+		done = 1;
+	}
+}
+
+//----------------------------DRAW---------------------------
+void draw() {
+	copy_state(state, state_buffer, 1);
+
+	lock_state(state);
+	int reset = resized;
+	resized = 0;
+	draw_cells(state, reset);
+	unlock_state(state);
+
+	flush_output();
+	perf_record_present(&perf, state, 0, ta.num_cells);
+}
+
+//--------------------------INITIALIZATION------------------
+int init_terminal() {
+	if (init_term_area(STDOUT_FILENO)) return 1;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGWINCH, &sa, NULL);
+
+	emit("\033[?25l");
+	flush_output();
+	return 0;
+}
+
+void tear_down_terminal() {
+	if (ta.out) {
+		emit("\033[0m\033[2J\033[H\033[?25h");
+		flush_output();
+	}
+	free_term_area();
+}
+
+//-------------------------------MAIN-----------------------------
+int main(int argc, char ** argv) {
+	char * attach_name = NULL;
+	char * alerts_path = NULL;
+	char * intervals = NULL;
+	char * control_path = NULL;
+	double log_interval = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "r:a:p:c:L:")) != -1) {
+		switch (opt) {
+		case 'r':
+			attach_name = optarg;
+			break;
+		case 'a':
+			alerts_path = optarg;
+			break;
+		case 'p':
+			intervals = optarg;
+			break;
+		case 'c':
+			control_path = optarg;
+			break;
+		case 'L':
+			log_interval = atof(optarg);
+			break;
+		default:
+			printf("Usage: %s [-L log_seconds] [-a alert_rules] [-p min_ms,max_ms] [-c control_socket] [-r shm_name] [instrument name]...\n", argv[0]);
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	if (!argc && !attach_name) {
+		printf("You must specify at least one instrument to subscribe to (example format: EUR_USD)\n");
+		return 1;
+	}
+
+	Alert_Rules * alerts = NULL;
+	if (alerts_path && !(alerts = load_alert_rules(alerts_path))) return 1;
+
+	Shm_State * shm = NULL;
+	if (attach_name && !(shm = attach_shm_state(attach_name))) return 1;
+
+	curl_global_init(CURL_GLOBAL_ALL);
+
+	if (init_terminal()) {
+		tear_down_terminal();
+		delete_shm_state(shm);
+		delete_alert_rules(alerts);
+		curl_global_cleanup();
+		return 1;
+	}
+
+	state = new_state();
+	state_buffer = new_state();
+	init_perf_stats(&perf, "terminal", log_interval);
+	pthread_t poll_thread;
+	if (attach_name) {
+		poll_thread = setup_state_and_shm_thread(state_buffer, shm);
+	} else {
+		state_buffer->alerts = alerts;
+		state_buffer->control_path = control_path;
+		poll_thread = 0;
+		if (!intervals || !set_poll_intervals(state_buffer, intervals)) {
+			poll_thread = setup_state_and_poll_thread(state_buffer, argc, argv);
+		}
+	}
+
+	struct timespec ts;
+	ts.tv_sec = 0;
+	ts.tv_nsec = FRAME_RATE;
+	while (!done && poll_thread) {
+		draw();
+		nanosleep(&ts, NULL);
+	}
+
+	destroy_state_and_poll_thread(state_buffer, poll_thread);
+	delete_state(state);
+	delete_shm_state(shm);
+	delete_alert_rules(alerts);
+	tear_down_terminal();
+	curl_global_cleanup();
+
+	return 0;
+}
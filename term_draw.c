@@ -0,0 +1,203 @@
+#include <sys/ioctl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "term_draw.h"
+#include "grid.h"
+
+#define FADE_STEP 2
+#define OUT_CAPACITY 65536
+
+/*
+ * A changed tile is shown bright until its draw state runs out, then dim.
+ * Two levels keep a price change to two repaints of the tile.
+ */
+static const int UP_COLORS[2] = {22, 46};
+static const int DOWN_COLORS[2] = {52, 196};
+
+Term_Area ta;
+
+int init_term_area(int fd) {
+	ta.fd = fd;
+	ta.width = 80;
+	ta.height = 24;
+	ta.num_cells = 0;
+	ta.cells = NULL;
+	ta.out_length = 0;
+	ta.written = 0;
+	ta.color = -1;
+	return !(ta.out = (char *)malloc(OUT_CAPACITY));
+}
+
+void free_term_area() {
+	if (ta.out) free(ta.out);
+	if (ta.cells) free(ta.cells);
+	ta.out = NULL;
+	ta.cells = NULL;
+}
+
+//----------------------------OUTPUT--------------------------
+void flush_output() {
+	size_t written = 0;
+	while (written < ta.out_length) {
+		ssize_t n = write(ta.fd, ta.out + written, ta.out_length - written);
+		if (n <= 0) break;
+		written += n;
+	}
+	ta.written += ta.out_length;
+	ta.out_length = 0;
+}
+
+// Flushes instead of truncating when a sequence does not fit, so escapes are never cut in half
+void emit(const char * format, ...) {
+	va_list args;
+	va_start(args, format);
+	int n = vsnprintf(ta.out + ta.out_length, OUT_CAPACITY - ta.out_length, format, args);
+	va_end(args);
+	if (n > 0 && ta.out_length + n >= OUT_CAPACITY && ta.out_length) {
+		flush_output();
+		va_start(args, format);
+		n = vsnprintf(ta.out, OUT_CAPACITY, format, args);
+		va_end(args);
+	}
+	if (n > 0) {
+		ta.out_length += n;
+		if (ta.out_length > OUT_CAPACITY - 1) ta.out_length = OUT_CAPACITY - 1;
+	}
+}
+
+// Only switches colour when it differs from the last one written
+static void set_color(int bold, int color) {
+	int sgr = bold << 8 | color;
+	if (sgr == ta.color) return;
+	emit("\033[%s38;5;%dm", bold ? "1;" : "22;", color);
+	ta.color = sgr;
+}
+
+//----------------------------DRAW---------------------------
+static void reset_layout(State * state) {
+	struct winsize ws;
+	if (!ioctl(ta.fd, TIOCGWINSZ, &ws) && ws.ws_col && ws.ws_row) {
+		ta.width = ws.ws_col;
+		ta.height = ws.ws_row;
+	}
+
+	if (ta.num_cells != state->num_instruments) {
+		if (ta.cells) free(ta.cells);
+		ta.num_cells = state->num_instruments;
+		if (!(ta.cells = calloc(ta.num_cells, sizeof(Cell)))) {
+			ta.num_cells = 0;
+		}
+	}
+	int i;
+	for (i = 0; i < ta.num_cells; ++i) {
+		ta.cells[i].instrument[0] = 0;
+		ta.cells[i].level = -1;
+	}
+	emit("\033[0m\033[2J");
+	ta.color = -1;
+}
+
+// Blanks the tile of a cell that is no longer shown
+static void erase_cell(Dimension d, int i) {
+	int width = ta.width / d.x;
+	int height = ta.height / d.y;
+	int left = width * (i % d.x) + 1;
+	int top = height * (i / d.x) + 1;
+	int row;
+	emit("\033[0m");
+	ta.color = -1;
+	for (row = 0; row < height; ++row) {
+		emit("\033[%d;%dH%*s", top + row, left, width, "");
+	}
+}
+
+// Subscription changes keep the tiles that stay in place unless the grid itself changes shape
+static void resize_cells(State * state) {
+	Dimension old_d = get_grid_for_num_instruments(ta.num_cells, ta.width, ta.height * 2);
+	Dimension d = get_grid_for_num_instruments(state->num_instruments, ta.width, ta.height * 2);
+	Cell * cells = d.x == old_d.x && d.y == old_d.y
+			? realloc(ta.cells, (state->num_instruments ? state->num_instruments : 1) * sizeof(Cell)) : NULL;
+	if (!cells) {
+		reset_layout(state);
+		return;
+	}
+	ta.cells = cells;
+
+	int i;
+	for (i = state->num_instruments; i < ta.num_cells; ++i) {
+		erase_cell(d, i);
+	}
+	for (i = ta.num_cells; i < state->num_instruments; ++i) {
+		ta.cells[i].instrument[0] = 0;
+		ta.cells[i].level = -1;
+	}
+	ta.num_cells = state->num_instruments;
+}
+
+// Writes the tiles that changed into the output buffer; the caller holds the state lock
+void draw_cells(State * state, int reset) {
+	if (reset) {
+		reset_layout(state);
+	} else if (ta.num_cells != state->num_instruments) {
+		resize_cells(state);
+	}
+
+	// Terminal cells are about twice as tall as they are wide
+	Dimension d = get_grid_for_num_instruments(ta.num_cells, ta.width, ta.height * 2);
+	int i;
+	for (i = 0; i < ta.num_cells; ++i) {
+		int width = ta.width / d.x;
+		int height = ta.height / d.y;
+		int left = width * (i % d.x) + 1;
+		int top = height * (i / d.x) + 1;
+
+		Instrument_State * is = &state->instruments[i];
+		Cell * cell = &ta.cells[i];
+
+		int level = is->draw_state > 0;
+		is->draw_state = is->draw_state > FADE_STEP ? is->draw_state - FADE_STEP : 0;
+		char alert = is->alert_state ? '!' : ' ';
+		is->alert_state = is->alert_state > FADE_STEP ? is->alert_state - FADE_STEP : 0;
+
+		char price[16];
+		snprintf(price, sizeof(price), "%f", is->price);
+
+		if (level == cell->level && is->direction == cell->direction && alert == cell->alert
+				&& !strcmp(price, cell->price) && !strcmp(is->instrument, cell->instrument)) {
+			continue;
+		}
+
+		if (cell->level >= 0 && strcmp(is->instrument, cell->instrument)) {
+			int old_left = left + (width - (int)strlen(cell->instrument)) / 2;
+			emit("\033[%d;%dH%*s", top + (height - 2) / 2, old_left > left ? old_left : left,
+					(int)strlen(cell->instrument), "");
+		}
+		if (cell->level >= 0 && strlen(price) != strlen(cell->price)) {
+			int old_left = left + (width - (int)strlen(cell->price) - 2) / 2;
+			emit("\033[%d;%dH%*s", top + (height - 2) / 2 + 1, old_left > left ? old_left : left,
+					(int)strlen(cell->price) + 2, "");
+		}
+
+		int color = is->direction == 'u' ? UP_COLORS[level] : DOWN_COLORS[level];
+		int name_left = left + (width - (int)strlen(is->instrument)) / 2;
+		int price_left = left + (width - (int)strlen(price) - 2) / 2;
+		int name_top = top + (height - 2) / 2;
+
+		// The name only needs rewriting when its colour or text changed
+		set_color(level, color);
+		if (level != cell->level || is->direction != cell->direction || strcmp(is->instrument, cell->instrument)) {
+			emit("\033[%d;%dH%s", name_top, name_left > left ? name_left : left, is->instrument);
+		}
+		emit("\033[%d;%dH%c%c%s", name_top + 1, price_left > left ? price_left : left,
+				is->direction == 'u' ? '^' : 'v', alert, price);
+
+		strcpy(cell->instrument, is->instrument);
+		strcpy(cell->price, price);
+		cell->direction = is->direction;
+		cell->alert = alert;
+		cell->level = level;
+	}
+}
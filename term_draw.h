@@ -0,0 +1,40 @@
+#ifndef TERM_DRAW
+#define TERM_DRAW
+
+#include <stddef.h>
+#include "poll_t.h"
+
+/*
+ * ANSI tile renderer behind termScreen. Each cell remembers what was last
+ * written to its tile, and only tiles whose text, direction, alert mark or
+ * highlight changed are rewritten. A frame's escapes are collected in out
+ * and written to fd in one go.
+ */
+typedef struct {
+	char instrument[16];
+	char price[16];
+	char direction;
+	char alert;
+	int level;
+} Cell;
+
+typedef struct {
+	int fd;
+	int width, height;
+	int num_cells;
+	Cell * cells;
+	char * out;
+	size_t out_length;
+	unsigned long written;
+	int color;
+} Term_Area;
+
+extern Term_Area ta;
+
+int init_term_area(int fd);
+void free_term_area();
+void flush_output();
+void emit(const char * format, ...);
+void draw_cells(State * state, int reset);
+
+#endif
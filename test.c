@@ -1,5 +1,6 @@
-#include "fetch.h"
+#include "poll_t.h"
 
+#include <curl/curl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -7,21 +8,24 @@
 int main(int argc, char ** argv) {
 	--argc;
 	++argv;
-	State state;
-	pthread_t thread = setup_state_and_poll_thread(&state, argc, argv);
+	curl_global_init(CURL_GLOBAL_ALL);
+	State * state = new_state();
+	State * state_buffer = new_state();
+	pthread_t thread = setup_state_and_poll_thread(state_buffer, argc, argv);
 	int count = 0;
 	while (count != 5 && thread) {
-		State * state_p;
-		if (state_p = getState(1)) {
+		if (is_ready(state_buffer)) {
+			copy_state(state, state_buffer, 1);
 			int i;
-			for (i = 0; i < state_p->num_instruments; ++i) {
-				Instrument_State * instrument = &state_p->instruments[i];
+			for (i = 0; i < state->num_instruments; ++i) {
+				Instrument_State * instrument = &state->instruments[i];
 				printf("%s %f %c\n", instrument->instrument, instrument->price, instrument->direction);
 			}
-			delete_state(state_p, 1);
 			++count;
 		}
 	}
-	close_poll_thread(thread);
-	delete_state(&state, 0);
+	destroy_state_and_poll_thread(state_buffer, thread);
+	delete_state(state);
+	curl_global_cleanup();
+	return 0;
 }
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <string.h>
+#include "alerts.h"
+
+#define FIXTURE "fixtures/alerts.txt"
+#define FIXTURE_RULES 7
+#define MAX_EXPECTED 4
+
+/*
+ * Replays a price sequence through the rules in the fixture and checks which
+ * rules fire at each step. Threshold rules fire for keys strictly passed
+ * over, so touching a level and turning back does not fire it again; move
+ * rules re-arm once the move inside their window falls back below them.
+ */
+typedef struct {
+	const char * instrument;
+	double time;
+	double price;
+	int expected[MAX_EXPECTED];
+} Step;
+
+static Step steps[] = {
+	{"EUR_USD", 0, 1.07, {-1}},
+	{"EUR_USD", 100, 1.09, {3, -1}},
+	{"EUR_USD", 200, 1.15, {0, -1}},
+	{"EUR_USD", 300, 1.25, {1, -1}},
+	{"EUR_USD", 400, 1.20, {-1}},
+	{"EUR_USD", 500, 1.21, {-1}},
+	{"EUR_USD", 600, 1.04, {2, 3, -1}},
+	{"EUR_USD", 700, 1.30, {3, 0, 1, -1}},
+	{"USD_JPY", 0, 100.0, {-1}},
+	{"USD_JPY", 1, 101.5, {4, -1}},
+	{"USD_JPY", 2, 102.5, {5, -1}},
+	{"USD_JPY", 3, 103.5, {6, -1}},
+	{"USD_JPY", 20, 103.5, {-1}},
+	{"USD_JPY", 21, 105.0, {4, -1}},
+	{"USD_JPY", 22, 102.0, {5, -1}},
+	{"USD_JPY", 23, 103.2, {6, -1}},
+};
+
+static double last_price(int step) {
+	int i;
+	for (i = step - 1; i >= 0; --i) {
+		if (!strcmp(steps[i].instrument, steps[step].instrument)) return steps[i].price;
+	}
+	return 0;
+}
+
+int main() {
+	Alert_Rules * rules = load_alert_rules(FIXTURE);
+	if (!rules) return 1;
+
+	int failed = 0;
+	if (rules->num_rules != FIXTURE_RULES) {
+		printf("FAIL: loaded %d rules, expected %d\n", rules->num_rules, FIXTURE_RULES);
+		failed = 1;
+	}
+
+	int num_steps = sizeof(steps) / sizeof(Step);
+	int i, j;
+	for (i = 0; i < num_steps && !failed; ++i) {
+		Step * step = &steps[i];
+		Alert_Batch batch;
+		int count = check_alerts(rules, &batch, step->instrument, last_price(i), step->price, step->time);
+
+		int num_expected;
+		for (num_expected = 0; step->expected[num_expected] >= 0; ++num_expected);
+		int matches = count == num_expected && batch.num_fired == num_expected;
+		for (j = 0; j < num_expected && matches; ++j) {
+			matches = batch.fired[j].rule == step->expected[j] && batch.fired[j].price == step->price;
+		}
+		if (!matches) {
+			printf("FAIL: step %d (%s %g at %gs) fired", i, step->instrument, step->price, step->time);
+			for (j = 0; j < batch.num_fired; ++j) printf(" %d", batch.fired[j].rule);
+			printf(", expected");
+			for (j = 0; j < num_expected; ++j) printf(" %d", step->expected[j]);
+			printf("\n");
+			failed = 1;
+		}
+	}
+	if (!failed) printf("PASS: %d price steps fired the expected rules\n", num_steps);
+
+	delete_alert_rules(rules);
+	return failed;
+}
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "s_string.h"
+#include "poll_t.h"
+
+#define FIXTURE "fixtures/poll.json"
+#define CHUNK_SIZE 1448
+#define WARM_UP_POLLS 3
+#define STEADY_POLLS 100
+
+/*
+ * Counts heap allocations made by the poll path: the response buffer, the
+ * price parser and the state update. Network I/O is replaced by feeding the
+ * captured fixture through write_func the way libcurl would.
+ */
+extern void * __libc_malloc(size_t size);
+extern void * __libc_calloc(size_t count, size_t size);
+extern void * __libc_realloc(void * ptr, size_t size);
+extern void __libc_free(void * ptr);
+
+static unsigned long allocations = 0;
+
+void * malloc(size_t size) {
+	++allocations;
+	return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size) {
+	++allocations;
+	return __libc_calloc(count, size);
+}
+
+void * realloc(void * ptr, size_t size) {
+	++allocations;
+	return __libc_realloc(ptr, size);
+}
+
+void free(void * ptr) {
+	__libc_free(ptr);
+}
+
+char * read_fixture(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return NULL;
+	fseek(f, 0, SEEK_END);
+	long length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char * data = (char *)malloc(length + 1);
+	if (data && fread(data, 1, length, f) != length) {
+		free(data);
+		data = NULL;
+	}
+	if (data) data[length] = 0;
+	fclose(f);
+	return data;
+}
+
+int poll_fixture(State * state, struct String * message, char * response) {
+	size_t length = strlen(response);
+	size_t offset;
+	reset_string(message);
+	for (offset = 0; offset < length; offset += CHUNK_SIZE) {
+		size_t chunk = length - offset < CHUNK_SIZE ? length - offset : CHUNK_SIZE;
+		if (write_func(response + offset, 1, chunk, message) != chunk) return -1;
+	}
+	return apply_poll_response(state, message->data, 0);
+}
+
+int main() {
+	char * response = read_fixture(FIXTURE);
+	if (!response) {
+		printf("Could not load fixture %s\n", FIXTURE);
+		return 1;
+	}
+
+	char * instruments[] = {"EUR_USD", "USD_JPY", "GBP_USD", "XAU_USD", "AUD_CAD"};
+	int num_instruments = sizeof(instruments) / sizeof(char *);
+	State * state = new_state();
+	int i;
+	for (i = 0; i < num_instruments; ++i) {
+		add_instrument(state, instruments[i]);
+	}
+	struct String message = {NULL, 0, 0, NULL};
+
+	for (i = 0; i < WARM_UP_POLLS; ++i) {
+		poll_fixture(state, &message, response);
+	}
+
+	int failed = 0;
+	unsigned long before = allocations;
+	for (i = 0; i < STEADY_POLLS; ++i) {
+		if (poll_fixture(state, &message, response) < 0) {
+			printf("FAIL: fixture could not be parsed\n");
+			failed = 1;
+			break;
+		}
+	}
+	unsigned long steady = allocations - before;
+
+	if (!state->ready || state->instruments[0].price <= 0) {
+		printf("FAIL: fixture prices were not applied\n");
+		failed = 1;
+	}
+	if (steady) {
+		printf("FAIL: %lu allocations in %d steady-state polls\n", steady, STEADY_POLLS);
+		failed = 1;
+	}
+	if (!failed) printf("PASS: 0 allocations in %d steady-state polls\n", STEADY_POLLS);
+
+	free(message.data);
+	delete_state(state);
+	free(response);
+	return failed;
+}
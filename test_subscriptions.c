@@ -0,0 +1,158 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "poll_t.h"
+#include "control.h"
+
+#define NUM_INSTRUMENTS 200
+#define REMOVE_STRIDE 7
+#define CONTROL_PATH "/tmp/test_subscriptions.sock"
+
+/*
+ * Adds and removes instruments the way the control socket does and checks
+ * that the name index still finds every instrument in its slot after
+ * backward-shift deletion. After each removal the render copy must mark
+ * only the slot refilled by the last instrument as changed and replaced,
+ * since the tiles and heatmap rows redraw, and the heatmap rebases, from
+ * exactly those flags.
+ *
+ * It also checks that a control client hanging up before its reply is
+ * written does not take the process down with SIGPIPE.
+ */
+static char names[NUM_INSTRUMENTS][16];
+static int removed[NUM_INSTRUMENTS];
+
+static double price_of(int i) {
+	return 1 + i / 1000.0;
+}
+
+static int check_lookups(State * state, int round) {
+	int i;
+	for (i = 0; i < NUM_INSTRUMENTS; ++i) {
+		setup_instrument(state, names[i], price_of(i) + round, price_of(i) + round, 0, 0);
+	}
+	for (i = 0; i < state->num_instruments; ++i) {
+		Instrument_State * is = &state->instruments[i];
+		int n;
+		if (sscanf(is->instrument, "I%d", &n) != 1 || removed[n] || is->price != price_of(n) + round) {
+			printf("FAIL: slot %d holds %s at %f after round %d\n", i, is->instrument, is->price, round);
+			return 1;
+		}
+	}
+	for (i = 0; i < NUM_INSTRUMENTS; ++i) {
+		if ((add_instrument(state, names[i]) < 0) != !removed[i]) {
+			printf("FAIL: index %s %s after round %d\n", removed[i] ? "still finds" : "lost", names[i], round);
+			return 1;
+		}
+		if (removed[i]) remove_instrument(state, names[i]);
+	}
+	return 0;
+}
+
+static int check_copy(State * render, State * state, int slot, int round) {
+	if (render->num_instruments != state->num_instruments) {
+		printf("FAIL: render copy has %d instruments, expected %d\n", render->num_instruments, state->num_instruments);
+		return 1;
+	}
+	int i;
+	for (i = 0; i < render->num_instruments; ++i) {
+		Instrument_State * is = &render->instruments[i];
+		int refilled = i == slot;
+		if (strcmp(is->instrument, state->instruments[i].instrument) || is->price != state->instruments[i].price
+				|| is->changed != refilled || is->replaced != refilled) {
+			printf("FAIL: render slot %d (%s) changed %d replaced %d after removal %d\n",
+					i, is->instrument, is->changed, is->replaced, round);
+			return 1;
+		}
+		is->replaced = 0;
+	}
+	return 0;
+}
+
+static int connect_control() {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, CONTROL_PATH);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd >= 0 && connect(fd, (struct sockaddr *)&address, sizeof(address))) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+// Sends list and reads the reply up to its final "ok"
+static int list_control(int fd) {
+	char reply[4096];
+	size_t length = 0;
+	if (write(fd, "list\n", 5) != 5) return 0;
+	while (length < sizeof(reply) - 1) {
+		ssize_t count = read(fd, reply + length, sizeof(reply) - 1 - length);
+		if (count <= 0) return 0;
+		length += count;
+		reply[length] = 0;
+		if (length >= 3 && !strcmp(reply + length - 3, "ok\n")) return 1;
+	}
+	return 0;
+}
+
+static int check_control(State * state) {
+	state->control_path = CONTROL_PATH;
+	if (!(state->control_thread = setup_control_thread(state))) {
+		printf("FAIL: control socket could not be set up\n");
+		return 1;
+	}
+
+	// The first client keeps the control thread busy while the second one sends and hangs up
+	int busy = connect_control();
+	int gone = connect_control();
+	int ok = busy >= 0 && gone >= 0 && write(gone, "list\n", 5) == 5;
+	if (gone >= 0) close(gone);
+	ok = ok && list_control(busy);
+	if (busy >= 0) close(busy);
+
+	// The reply to the closed client has been written by the time a third client is served
+	int after = connect_control();
+	ok = ok && after >= 0 && list_control(after);
+	if (after >= 0) close(after);
+	if (!ok) printf("FAIL: control socket stopped answering after a client hung up\n");
+	return !ok;
+}
+
+int main() {
+	State * state = new_state();
+	State * render = new_state();
+	int i;
+	for (i = 0; i < NUM_INSTRUMENTS; ++i) {
+		snprintf(names[i], sizeof(names[i]), "I%03d", i);
+		add_instrument(state, names[i]);
+	}
+	int failed = check_lookups(state, 0);
+	mark_ready(state);
+	copy_state(render, state, 0);
+	for (i = 0; i < render->num_instruments; ++i) {
+		render->instruments[i].replaced = 0;
+	}
+
+	int rounds = 0;
+	for (i = 0; i < NUM_INSTRUMENTS && !failed; i += REMOVE_STRIDE) {
+		int index = (i * 13) % NUM_INSTRUMENTS;
+		int last = state->num_instruments - 1;
+		int slot = remove_instrument(state, names[index]);
+		removed[index] = 1;
+		++rounds;
+		mark_ready(state);
+		copy_state(render, state, 0);
+		failed = check_copy(render, state, slot == last ? -1 : slot, rounds);
+	}
+	if (!failed) failed = check_lookups(state, 1);
+	if (!failed) failed = check_control(state);
+	if (!failed) printf("PASS: %d removals kept the index and render slots in step, control survived a hang-up\n", rounds);
+
+	delete_state(render);
+	destroy_state_and_poll_thread(state, 0);
+	return failed;
+}
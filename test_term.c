@@ -0,0 +1,92 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "poll_t.h"
+#include "term_draw.h"
+
+#define NUM_INSTRUMENTS 40
+#define FRAMES_PER_TICK 15
+#define TICKS 40
+#define QUIET_CHANGES 4
+#define TICK_BUDGET 400
+#define BOARD_BUDGET 2048
+
+/*
+ * Counts the bytes the terminal renderer writes per poll tick for a
+ * 40-instrument board polled every 500 ms (15 frames at termScreen's
+ * frame rate), once with a few instruments moving per tick and once with
+ * the whole board moving. Each tick's count covers the frames until the
+ * next tick, so the repaints of fading tiles are included.
+ */
+static State * state, * state_buffer;
+static char names[NUM_INSTRUMENTS][16];
+
+static void run_frames(int frames) {
+	int i;
+	for (i = 0; i < frames; ++i) {
+		copy_state(state, state_buffer, 1);
+		lock_state(state);
+		draw_cells(state, 0);
+		unlock_state(state);
+		flush_output();
+	}
+}
+
+// Returns the average bytes per tick with changes instruments moving each tick
+static double measure(int changes, int * seed) {
+	unsigned long before = ta.written;
+	int tick, i;
+	for (tick = 0; tick < TICKS; ++tick) {
+		for (i = 0; i < changes; ++i) {
+			*seed = (*seed * 1103515245 + 12345) & 0x7fffffff;
+			int slot = changes == NUM_INSTRUMENTS ? i : *seed % NUM_INSTRUMENTS;
+			double price = 1 + (*seed % 100000) / 100000.0;
+			setup_instrument(state_buffer, names[slot], price, price, 0, 0);
+		}
+		mark_ready(state_buffer);
+		run_frames(FRAMES_PER_TICK);
+	}
+	return (double)(ta.written - before) / TICKS;
+}
+
+int main() {
+	int fd = open("/dev/null", O_WRONLY);
+	if (fd < 0 || init_term_area(fd)) return 1;
+	state = new_state();
+	state_buffer = new_state();
+	int i;
+	for (i = 0; i < NUM_INSTRUMENTS; ++i) {
+		snprintf(names[i], sizeof(names[i]), "INS_%03d", i);
+		add_instrument(state_buffer, names[i]);
+		setup_instrument(state_buffer, names[i], 1, 1, 0, 0);
+	}
+	mark_ready(state_buffer);
+	copy_state(state, state_buffer, 1);
+	lock_state(state);
+	draw_cells(state, 1);
+	unlock_state(state);
+	flush_output();
+	run_frames(FRAMES_PER_TICK * 4);
+
+	int seed = 1;
+	double quiet = measure(QUIET_CHANGES, &seed);
+	run_frames(FRAMES_PER_TICK * 4);
+	double board = measure(NUM_INSTRUMENTS, &seed);
+
+	int failed = 0;
+	if (quiet > TICK_BUDGET) {
+		printf("FAIL: %.0f bytes per tick with %d of %d instruments moving, budget %d\n", quiet, QUIET_CHANGES, NUM_INSTRUMENTS, TICK_BUDGET);
+		failed = 1;
+	}
+	if (board > BOARD_BUDGET) {
+		printf("FAIL: %.0f bytes per tick with the whole board moving, budget %d\n", board, BOARD_BUDGET);
+		failed = 1;
+	}
+	if (!failed) printf("PASS: %.0f bytes per tick with %d of %d instruments moving, %.0f with all of them\n", quiet, QUIET_CHANGES, NUM_INSTRUMENTS, board);
+
+	free_term_area();
+	delete_state(state);
+	delete_state(state_buffer);
+	close(fd);
+	return failed;
+}